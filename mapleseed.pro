@@ -28,6 +28,13 @@ CONFIG += c++11
 
 INCLUDEPATH += src
 
+# save archives use zlib directly, from Qt's own copy unless Qt was built
+# against the system one
+qtConfig(system-zlib) {
+    DEFINES += MAPLESEED_SYSTEM_ZLIB
+    LIBS += -lz
+}
+
 FORMS += \
         mainwindow.ui
 
@@ -36,28 +43,62 @@ SOURCES += \
         src/cemu/crypto.cpp \
         src/cemu/database.cpp \
         src/cemu/library.cpp \
+        src/cemu/librarycache.cpp \
+        src/cemu/metaxml.cpp \
+        src/cemu/searchindex.cpp \
+        src/cemu/snapshot.cpp \
+        src/cemu/titlekeyreader.cpp \
+        src/cemu/tmdfetcher.cpp \
+        src/cemu/verifier.cpp \
         src/gamepad.cpp \
         src/helper.cpp \
         src/logging.cpp \
         src/main.cpp \
         src/mainwindow.cpp \
+        src/metrics.cpp \
+        src/network/concurrency.cpp \
+        src/network/downloadjournal.cpp \
         src/network/downloadqueue.cpp \
-        src/network/queueinfo.cpp
+        src/network/downloadsink.cpp \
+        src/network/downloadtransfer.cpp \
+        src/network/queueinfo.cpp \
+        src/network/ratelimiter.cpp \
+        src/progress.cpp \
+        src/settings.cpp \
+        src/trace.cpp
 
 HEADERS += \
         src/cemu/QtCompressor.h \
         src/cemu/crypto.h \
         src/cemu/database.h \
         src/cemu/library.h \
+        src/cemu/librarycache.h \
+        src/cemu/metaxml.h \
+        src/cemu/searchindex.h \
+        src/cemu/snapshot.h \
+        src/cemu/titleindex.h \
+        src/cemu/titlekeyreader.h \
+        src/cemu/titlestore.h \
+        src/cemu/tmdfetcher.h \
+        src/cemu/verifier.h \
         src/gamepad.h \
         src/helper.h \
         src/logging.h \
+        src/logring.h \
         src/mainwindow.h \
+        src/metrics.h \
+        src/progress.h \
         src/settings.h \
         src/titleinfo.h \
+        src/trace.h \
+        src/network/concurrency.h \
+        src/network/downloadjournal.h \
         src/network/downloadqueue.h \
+        src/network/downloadsink.h \
+        src/network/downloadtransfer.h \
         src/network/network_global.h \
         src/network/queueinfo.h \
+        src/network/ratelimiter.h \
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
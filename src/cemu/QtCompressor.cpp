@@ -1,11 +1,145 @@
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
 #include "QtCompressor.h"
+#include "trace.h"
+
+#ifdef MAPLESEED_SYSTEM_ZLIB
+#include <zlib.h>
+#else
+#include <QtZlib/zlib.h>
+#endif
+
+namespace
+{
+    enum ChunkKind : quint8
+    {
+        Stored = 0,
+        Deflated = 1
+    };
+
+    //zlib state is kept per pool thread and reset for every chunk, so each
+    //chunk can be inflated on its own without paying for a new state
+    struct Deflater
+    {
+        z_stream stream;
+        int level = -1;
+
+        ~Deflater()
+        {
+            if (level >= 0)
+            {
+                deflateEnd(&stream);
+            }
+        }
+    };
+
+    struct Inflater
+    {
+        z_stream stream;
+        bool ready = false;
+
+        ~Inflater()
+        {
+            if (ready)
+            {
+                inflateEnd(&stream);
+            }
+        }
+    };
+
+    //returns the whole chunk record, kind and length included
+    QByteArray deflateChunk(const QByteArray& data, int level)
+    {
+        TRACE_SPAN("archive", "deflate chunk");
+        static thread_local Deflater deflater;
+        const int header = 5;
+
+        QByteArray record;
+        int packed = 0;
+        if (level > 0)
+        {
+            auto stream = &deflater.stream;
+            if (deflater.level != level)
+            {
+                if (deflater.level >= 0)
+                {
+                    deflateEnd(stream);
+                }
+                memset(stream, 0, sizeof(z_stream));
+                deflater.level = deflateInit(stream, level) == Z_OK ? level : -1;
+            }
+
+            if (deflater.level == level)
+            {
+                record.resize(header + static_cast<int>(compressBound(static_cast<uLong>(data.size()))));
+                deflateReset(stream);
+                stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+                stream->avail_in = static_cast<uInt>(data.size());
+                stream->next_out = reinterpret_cast<Bytef*>(record.data() + header);
+                stream->avail_out = static_cast<uInt>(record.size() - header);
+                if (deflate(stream, Z_FINISH) == Z_STREAM_END)
+                {
+                    packed = static_cast<int>(stream->total_out);
+                }
+            }
+        }
+
+        if (packed > 0 && packed < data.size())
+        {
+            record.resize(header + packed);
+            record[0] = static_cast<char>(Deflated);
+        }
+        else
+        {
+            record.resize(header + data.size());
+            record[0] = static_cast<char>(Stored);
+            memcpy(record.data() + header, data.constData(), static_cast<size_t>(data.size()));
+            packed = data.size();
+        }
+        qToBigEndian(static_cast<quint32>(packed), record.data() + 1);
+        return record;
+    }
+
+    //empty when the chunk does not inflate to exactly length bytes
+    QByteArray inflateChunk(const QByteArray& data, int length)
+    {
+        TRACE_SPAN("archive", "inflate chunk");
+        static thread_local Inflater inflater;
+        auto stream = &inflater.stream;
+        if (!inflater.ready)
+        {
+            memset(stream, 0, sizeof(z_stream));
+            inflater.ready = inflateInit(stream) == Z_OK;
+            if (!inflater.ready)
+                return QByteArray();
+        }
+
+        QByteArray output(length, Qt::Uninitialized);
+        inflateReset(stream);
+        stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+        stream->avail_in = static_cast<uInt>(data.size());
+        stream->next_out = reinterpret_cast<Bytef*>(output.data());
+        stream->avail_out = static_cast<uInt>(length);
+        if (inflate(stream, Z_FINISH) != Z_STREAM_END || stream->total_out != static_cast<uLong>(length))
+            return QByteArray();
+
+        return output;
+    }
+}
 
 QtCompressor::QtCompressor(QObject *parent) : QObject(parent)
 {
 }
 
+void QtCompressor::setLevel(int level)
+{
+    compressionLevel = qBound(0, level, 9);
+}
+
 bool QtCompressor::compress(const QString& sourceFolder, const QString& destinationFile)
 {
+    TRACE_SPAN("archive", "compress");
     QDir src(sourceFolder);
     if(!src.exists())
     {
@@ -13,26 +147,47 @@ bool QtCompressor::compress(const QString& sourceFolder, const QString& destinat
         return false;
     }
 
-    file.setFileName(destinationFile);
+    //a failed backup must not leave half an archive behind
+    QSaveFile file(destinationFile);
     if(!file.open(QIODevice::WriteOnly))
     {
         qCritical() << "could not open file" << destinationFile;
         return false;
     }
 
+    curFile = 0;
+    numFiles = count(sourceFolder);
+    qInfo() << "Compressing" << sourceFolder;
+    progress = ProgressMonitor::track("archive", "Exporting " + src.dirName(), ProgressTracker::Files);
+    progress->setTotal(numFiles);
+
+    archive = &file;
+    window = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * ChunksPerThread);
     dataStream.setDevice(&file);
-	bool success;
+    dataStream.setVersion(QDataStream::Qt_5_12);
+    dataStream << Magic << Version << static_cast<quint32>(ChunkSize) << static_cast<quint32>(numFiles);
 
-	countDown += numFiles = count(sourceFolder);
-    qInfo() << "Compressing" << sourceFolder;
+    bool success = handleCompress(sourceFolder, "") && drain();
+    if (success)
+    {
+        dataStream << static_cast<quint8>(0);
+        success = dataStream.status() == QDataStream::Ok && file.commit();
+    }
+    else
+    {
+        abandon();
+        file.cancelWriting();
+    }
 
-	if (!(success = handleCompress(sourceFolder, ""))) {
+    if (!success) {
         qCritical() << "Compression failed" << sourceFolder;
-	}else{
+    }else{
         qDebug() << "Compression successful" << sourceFolder;
-	}
+    }
 
-    file.close();
+    dataStream.setDevice(nullptr);
+    archive = nullptr;
+    progress->finish();
     return success;
 }
 
@@ -51,7 +206,8 @@ bool QtCompressor::handleCompress(const QString& sourceFolder, const QString& pr
 		QString folderPath = dir.absolutePath() + "/" + folderName;
 		QString newPrefex = prefex + "/" + folderName;
 
-		handleCompress(folderPath, newPrefex);
+        if (!handleCompress(folderPath, newPrefex))
+            return false;
 	}
 
 	dir.setFilter(QDir::NoDotAndDotDot | QDir::Files);
@@ -69,20 +225,61 @@ bool QtCompressor::handleCompress(const QString& sourceFolder, const QString& pr
         QString filename(prefex + "/" + it.fileName());
         qInfo() << "Compressing" << file.fileName() << "<<" << filename;
 
-		dataStream << --countDown;
-		dataStream << filename;
-		dataStream << qCompress(file.readAll(), 9);
-
-        emit Progress(curFile++, numFiles);
+        if (!compressFile(&file, filename))
+            return false;
 
+        curFile++;
 		file.close();
 	}
 
 	return true;
 }
 
+bool QtCompressor::compressFile(QFile *in, const QString& name)
+{
+    TraceSpan span("archive", "read file");
+    qint64 size = in->size();
+    span.setValue(size);
+
+    //the file header goes out in front of the first chunk, so it can not
+    //overtake chunks of the file before
+    Pending pending;
+    {
+        QDataStream header(&pending.prefix, QIODevice::WriteOnly);
+        header.setVersion(QDataStream::Qt_5_12);
+        header << static_cast<quint8>(1) << name << size;
+    }
+
+    if (size == 0)
+    {
+        pending.last = true;
+        return submit(pending);
+    }
+
+    for (qint64 remaining = size; remaining > 0;)
+    {
+        int len = static_cast<int>(qMin(static_cast<qint64>(ChunkSize), remaining));
+        QByteArray chunk(in->read(len));
+        if (chunk.size() != len)
+        {
+            qCritical() << "couldn't read file" << in->fileName() << in->errorString();
+            return false;
+        }
+        remaining -= len;
+
+        pending.chunk = QtConcurrent::run(deflateChunk, chunk, compressionLevel);
+        pending.hasChunk = true;
+        pending.last = remaining == 0;
+        if (!submit(pending))
+            return false;
+        pending.prefix.clear();
+    }
+    return true;
+}
+
 bool QtCompressor::decompress(const QString& sourceFile, const QString& destinationFolder)
 {
+    TRACE_SPAN("archive", "decompress");
 	//validation
 	QFile src(sourceFile);
 	if (!src.exists())
@@ -95,14 +292,200 @@ bool QtCompressor::decompress(const QString& sourceFile, const QString& destinat
 		return false;
 	}
 
-	file.setFileName(sourceFile);
-	if (!file.open(QIODevice::ReadOnly))
+	if (!src.open(QIODevice::ReadOnly))
 		return false;
 
-	dataStream.setDevice(&file);
-	int count = 0;
-	int max = 0;
+    progress = ProgressMonitor::track("archive", "Importing " + QFileInfo(sourceFile).fileName(), ProgressTracker::Files);
+    dataStream.setDevice(&src);
+    dataStream.setVersion(QDataStream::Qt_5_12);
 
+    //an old archive opens with a file index, which never gets near the
+    //value of the magic
+    quint32 magic = 0;
+    dataStream >> magic;
+    bool success;
+    if (magic == Magic)
+    {
+        window = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * ChunksPerThread);
+        success = decompressChunked(destinationFolder) && drain();
+        if (!success)
+        {
+            abandon();
+        }
+    }
+    else
+    {
+        src.seek(0);
+        dataStream.resetStatus();
+        success = decompressLegacy(destinationFolder);
+    }
+
+    dataStream.setDevice(nullptr);
+    progress->finish();
+	src.close();
+	return success;
+}
+
+bool QtCompressor::decompressChunked(const QString& destinationFolder)
+{
+    quint32 version = 0;
+    quint32 chunkSize = 0;
+    quint32 files = 0;
+    dataStream >> version >> chunkSize >> files;
+    if (version != Version || chunkSize == 0 || chunkSize > 64 * 1024 * 1024)
+    {
+        qCritical() << "unsupported archive version" << version;
+        return false;
+    }
+    progress->setTotal(files);
+
+    forever
+    {
+        quint8 tag = 0;
+        dataStream >> tag;
+        if (dataStream.status() != QDataStream::Ok)
+        {
+            qCritical() << "archive is truncated";
+            return false;
+        }
+        if (tag == 0)
+            break;
+
+        QString fileName;
+        qint64 size = 0;
+        dataStream >> fileName >> size;
+
+        QString path;
+        if (dataStream.status() != QDataStream::Ok || size < 0 || !prepare(destinationFolder, fileName, &path))
+            return false;
+
+        qInfo() << "Decompression:" + destinationFolder << "<<" << fileName;
+
+        auto outFile = std::make_shared<QFile>(path);
+        if (!outFile->open(QIODevice::WriteOnly))
+        {
+            qCritical() << "could not write" << path << outFile->errorString();
+            return false;
+        }
+        if (!decompressFile(outFile, size, static_cast<int>(chunkSize)))
+            return false;
+    }
+    return true;
+}
+
+bool QtCompressor::decompressFile(const std::shared_ptr<QFile>& out, qint64 size, int chunkSize)
+{
+    TraceSpan span("archive", "read file");
+    span.setValue(size);
+    auto bound = static_cast<quint32>(compressBound(static_cast<uLong>(chunkSize)));
+
+    Pending pending;
+    pending.file = out;
+    if (size == 0)
+    {
+        pending.last = true;
+        return submit(pending);
+    }
+
+    for (qint64 remaining = size; remaining > 0;)
+    {
+        int len = static_cast<int>(qMin(static_cast<qint64>(chunkSize), remaining));
+        quint8 kind = 0;
+        quint32 stored = 0;
+        dataStream >> kind >> stored;
+
+        bool valid = dataStream.status() == QDataStream::Ok &&
+                ((kind == Stored && stored == static_cast<quint32>(len)) ||
+                 (kind == Deflated && stored <= bound));
+        QByteArray data(valid ? static_cast<int>(stored) : 0, Qt::Uninitialized);
+        if (!valid || dataStream.readRawData(data.data(), data.size()) != data.size())
+        {
+            qCritical() << "archive is damaged at" << out->fileName();
+            return false;
+        }
+        remaining -= len;
+
+        //stored chunks need no work, they just wait for their turn
+        pending.hasChunk = kind == Deflated;
+        pending.prefix = pending.hasChunk ? QByteArray() : data;
+        pending.chunk = pending.hasChunk ? QtConcurrent::run(inflateChunk, data, len) : QFuture<QByteArray>();
+        pending.length = len;
+        pending.last = remaining == 0;
+        if (!submit(pending))
+            return false;
+    }
+    return true;
+}
+
+bool QtCompressor::submit(const Pending& pending)
+{
+    inflight.enqueue(pending);
+    while (inflight.count() > window)
+    {
+        auto oldest = inflight.dequeue();
+        if (!write(oldest))
+            return false;
+    }
+    return true;
+}
+
+bool QtCompressor::write(Pending& pending)
+{
+    QIODevice *out = pending.file ? pending.file.get() : archive;
+    QByteArray data(pending.hasChunk ? pending.chunk.result() : QByteArray());
+    if (pending.file && pending.hasChunk && data.size() != pending.length)
+    {
+        qCritical() << "archive is damaged at" << pending.file->fileName();
+        return false;
+    }
+
+    if ((!pending.prefix.isEmpty() && out->write(pending.prefix) != pending.prefix.size()) ||
+            (!data.isEmpty() && out->write(data) != data.size()))
+    {
+        qCritical() << "could not write" << out->errorString();
+        return false;
+    }
+
+    if (pending.last)
+    {
+        if (pending.file)
+        {
+            pending.file->close();
+        }
+        progress->add(1);
+    }
+    return true;
+}
+
+bool QtCompressor::drain()
+{
+    while (!inflight.isEmpty())
+    {
+        auto oldest = inflight.dequeue();
+        if (!write(oldest))
+            return false;
+    }
+    return true;
+}
+
+void QtCompressor::abandon()
+{
+    //the jobs own copies of their data, they only have to finish
+    for (auto& pending : inflight)
+    {
+        if (pending.hasChunk)
+        {
+            pending.chunk.waitForFinished();
+        }
+    }
+    inflight.clear();
+}
+
+bool QtCompressor::decompressLegacy(const QString& destinationFolder)
+{
+    //one record per file: a countdown index, the name, and the whole file
+    //through qCompress
+    bool first = true;
 	while (!dataStream.atEnd())
 	{
 		int index;
@@ -111,38 +494,53 @@ bool QtCompressor::decompress(const QString& sourceFile, const QString& destinat
 
 		//extract file name and data in order
 		dataStream >> index >> fileName >> data;
+        if (dataStream.status() != QDataStream::Ok)
+        {
+            qCritical() << "archive is truncated";
+            return false;
+        }
+        TraceSpan span("archive", "decompress file");
+        span.setValue(data.size());
         qInfo() << "Decompression:" + destinationFolder << "<<" << fileName;
 
-		if (max == 0) max = index;
+        if (first)
+        {
+            progress->setTotal(index + 1);
+            first = false;
+        }
 
-		//create any needed folder
-		QString subfolder;
-		for (int i = fileName.length() - 1; i > 0; i--)
-		{
-			if ((QString(fileName.at(i)) == QString("\\")) || (QString(fileName.at(i)) == QString("/")))
-			{
-				subfolder = fileName.left(i);
-				dir.mkpath(destinationFolder + "/" + subfolder);
-				break;
-			}
-		}
+        QString path;
+        if (!prepare(destinationFolder, fileName, &path))
+            return false;
 
-		QFile outFile(destinationFolder + "/" + fileName);
+		QFile outFile(path);
 		if (!outFile.open(QIODevice::WriteOnly))
-		{
-			file.close();
 			return false;
-		}
 		outFile.write(qUncompress(data));
 		outFile.close();
 
-        emit Progress(count++, max - 1);
+        progress->add(1);
 	}
-
-	file.close();
 	return true;
 }
 
+bool QtCompressor::prepare(const QString& destinationFolder, const QString& fileName, QString *path)
+{
+    QString clean(QDir::cleanPath(QString(fileName).replace('\\', '/')));
+    while (clean.startsWith('/'))
+    {
+        clean.remove(0, 1);
+    }
+    if (clean.isEmpty() || clean == ".." || clean.startsWith("../"))
+    {
+        qCritical() << "refusing to extract" << fileName;
+        return false;
+    }
+
+    *path = QDir(destinationFolder).filePath(clean);
+    return QDir().mkpath(QFileInfo(*path).path());
+}
+
 int QtCompressor::count(const QString& directory)
 {
 	QDir dir(directory);
@@ -8,7 +8,16 @@
 #include <QDir>
 #include <QFile>
 #include <QDataStream>
+#include <QQueue>
+#include <memory>
+#include "progress.h"
 
+//Save data archives. Files are cut into fixed-size chunks that are run
+//through zlib on the thread pool, and a chunk that does not shrink is
+//stored as it is. Results are written strictly in the order the chunks
+//were read, so the archive comes out the same on any number of cores,
+//and only a couple of chunks per thread are ever in memory. Archives
+//written before chunking, one qCompress blob per file, are still read.
 class QtCompressor : public QObject
 {
     Q_OBJECT
@@ -16,29 +25,69 @@ public:
     explicit QtCompressor(QObject *parent = nullptr);
 
     //A recursive function that scans all files inside the source folder
-    //and serializes all files in a row of file names and compressed
-    //binary data in a single file
+    //and streams them into a single archive, chunk by chunk
     bool compress(const QString& sourceFolder, const QString& destinationFile);
 
     //handles compression of indiviual directories, iterating through levels
     bool handleCompress(const QString& sourceFolder, const QString& prefex);
 
-    //A function that deserializes data from the compressed file and
-    //creates any needed subfolders before saving the file
+    //A function that reads the archive back, creating any needed
+    //subfolders before saving each file
     bool decompress(const QString& sourceFile, const QString& destinationFolder);
 
 	//counts the number of files in a directory
     int count(const QString& directory);
 
+    //zlib level from 0 to 9, used by the next compress
+    void setLevel(int level);
+
+    int level() const { return compressionLevel; }
+
+    //counts files of the running compress or decompress
+    std::shared_ptr<ProgressTracker> progress;
+
+    static const quint32 Magic = 0x4D535141;
+    static const quint32 Version = 2;
+    static const int ChunkSize = 256 * 1024;
+    static const int DefaultLevel = 6;
+
+    //chunks in flight per pool thread
+    static const int ChunksPerThread = 2;
+
 private:
-    QFile file;
+    //one chunk on its way to its file, in the order it was read
+    struct Pending
+    {
+        QByteArray prefix;
+        QFuture<QByteArray> chunk;
+        bool hasChunk = false;
+        int length = 0;
+        std::shared_ptr<QFile> file;
+        bool last = false;
+    };
+
+    bool compressFile(QFile *in, const QString& name);
+    bool decompressFile(const std::shared_ptr<QFile>& out, qint64 size, int chunkSize);
+    bool decompressChunked(const QString& destinationFolder);
+    bool decompressLegacy(const QString& destinationFolder);
+
+    //queues a chunk, writing the oldest ones while the window is full
+    bool submit(const Pending& pending);
+    bool write(Pending& pending);
+    bool drain();
+    void abandon();
+
+    //creates the folders for an archived name, false if it would escape
+    //the destination
+    static bool prepare(const QString& destinationFolder, const QString& fileName, QString *path);
+
     QDataStream dataStream;
+    QIODevice *archive = nullptr;
+    QQueue<Pending> inflight;
+    int window = 1;
+    int compressionLevel = DefaultLevel;
     int curFile{};
     int numFiles{};
-    int countDown{};
-	
-signals:
-    void Progress(qint64 min, qint64 max);
 };
 
 #endif // QTCOMPRESSOR_H
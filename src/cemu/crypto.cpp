@@ -1,5 +1,15 @@
 #include <utility>
 #include "cemu/crypto.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace
+{
+    Counter *const decryptedBytes = Metrics::counter("decrypt_bytes_total", "Bytes of title files decrypted and written.");
+    Counter *const hashChecks = Metrics::counter("decrypt_h0_checks_total", "H0 hashes checked on hashed content.");
+    Counter *const hashFailures = Metrics::counter("decrypt_h0_failures_total", "H0 hashes that did not match the decrypted block.");
+    Histogram *const blockLatency = Metrics::histogram("decrypt_block_us", "Time to read, decrypt and write one content block, in microseconds.");
+}
 
 CemuCrypto::CemuCrypto() = default;
 
@@ -16,8 +26,13 @@ CemuCrypto *CemuCrypto::initialize(QString titleKey, QString basedir)
 
 void CemuCrypto::Start()
 {
+    if (!progress)
+    {
+        progress = ProgressMonitor::track("decrypt", QDir(Directory).dirName(), ProgressTracker::Bytes);
+    }
     qInfo() << "Decrypt:" << Directory;
     qInfo() << "Decrypt Exit Code:" << Decrypt();
+    progress->finish();
 }
 
 quint16 CemuCrypto::bs16(quint16 s)
@@ -40,6 +55,36 @@ qulonglong CemuCrypto::bs64(qulonglong i)
     return static_cast<qulonglong>(((static_cast<qulonglong>(bs32(i & 0xFFFFFFFF))) << 32) | (bs32(i >> 32)));
 }
 
+QByteArray CemuCrypto::DecryptTitleKey(const char* tmd, const QString& titleKey)
+{
+    CemuCrypto crypto;
+    AES_KEY key{};
+    if (strcmp(tmd + 0x140, "Root-CA00000003-CP0000000b") == 0)
+    {
+        AES_set_decrypt_key(reinterpret_cast<const quint8*>(crypto.WiiUCommenKey), sizeof(crypto.WiiUCommenKey) * 8, &key);
+    }
+    else if (strcmp(tmd + 0x140, "Root-CA00000004-CP00000010") == 0)
+    {
+        AES_set_decrypt_key(reinterpret_cast<const quint8*>(crypto.WiiUCommenDevKey), sizeof(crypto.WiiUCommenDevKey) * 8, &key);
+    }
+    else
+    {
+        return QByteArray();
+    }
+
+    QByteArray encrypted(QByteArray::fromHex(titleKey.toLatin1()));
+    if (encrypted.size() != 16)
+        return QByteArray();
+
+    quint8 iv[16];
+    memset(iv, 0, sizeof(iv));
+    memcpy(iv, tmd + 0x18C, 8);
+
+    QByteArray decrypted(16, 0);
+    AES_cbc_encrypt(reinterpret_cast<const quint8*>(encrypted.constData()), reinterpret_cast<quint8*>(decrypted.data()), 16, &key, iv, AES_DECRYPT);
+    return decrypted;
+}
+
 char* CemuCrypto::ReadFile(const QString& file, quint32 *len)
 {
     QFile in(file);
@@ -59,8 +104,10 @@ char* CemuCrypto::ReadFile(const QString& file, quint32 *len)
 }
 
 #define BLOCK_SIZE  0x10000
-void CemuCrypto::ExtractFileHash(QFile * in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID, int i1, int i2)
+void CemuCrypto::ExtractFileHash(QFile * in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID)
 {
+    TraceSpan span("decrypt", "extract hashed file");
+    span.setValue(static_cast<qint64>(Size));
     char decdata[BLOCK_SIZE];
     unsigned char IV[16];
     unsigned char hash[SHA_DIGEST_LENGTH];
@@ -90,6 +137,8 @@ void CemuCrypto::ExtractFileHash(QFile * in, qulonglong PartDataOffset, qulonglo
         if (WriteSize > Size)
             WriteSize = Size;
 
+        QElapsedTimer timer;
+        timer.start();
         auto* temp_encdata = new char[BLOCK_SIZE]();
         auto len = static_cast<qulonglong>(in->read(temp_encdata, BLOCK_SIZE));
 
@@ -113,16 +162,19 @@ void CemuCrypto::ExtractFileHash(QFile * in, qulonglong PartDataOffset, qulonglo
 
         if (Block == 0)
             hash[1] ^= ContentID;
-        H0Count++;
+        hashChecks->add();
 
         if (memcmp(hash, H0, SHA_DIGEST_LENGTH) != 0)
         {
-            H0Fail++;
+            hashFailures->add();
             qCritical() << "failed to verify H0 hash:" << out->fileName();
             return;
         }
 
         Size -= static_cast<qulonglong>(out->write(decdata + soffset, static_cast<qint64>(WriteSize)));
+        decryptedBytes->add(static_cast<qint64>(WriteSize));
+        progress->add(static_cast<qint64>(WriteSize));
+        blockLatency->record(timer.nsecsElapsed() / 1000);
 
         Wrote += WriteSize;
 
@@ -135,7 +187,6 @@ void CemuCrypto::ExtractFileHash(QFile * in, qulonglong PartDataOffset, qulonglo
             WriteSize = 0xFC00;
             soffset = 0;
         }
-        emit Progress(i1, i2);
     }
 
     out->close();
@@ -144,8 +195,10 @@ void CemuCrypto::ExtractFileHash(QFile * in, qulonglong PartDataOffset, qulonglo
 #undef BLOCK_SIZE
 
 #define BLOCK_SIZE  0x8000
-void CemuCrypto::ExtractFile(QFile * in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID, int i1, int i2)
+void CemuCrypto::ExtractFile(QFile * in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID)
 {
+    TraceSpan span("decrypt", "extract file");
+    span.setValue(static_cast<qint64>(Size));
     char decdata[BLOCK_SIZE];
     qulonglong Wrote = 0;
 
@@ -174,6 +227,8 @@ void CemuCrypto::ExtractFile(QFile * in, qulonglong PartDataOffset, qulonglong F
         if (WriteSize > Size)
             WriteSize = Size;
 
+        QElapsedTimer timer;
+        timer.start();
         auto* temp_encdata = new char[BLOCK_SIZE]();
         auto len = static_cast<qulonglong>(in->read(temp_encdata, BLOCK_SIZE));
 
@@ -184,13 +239,15 @@ void CemuCrypto::ExtractFile(QFile * in, qulonglong PartDataOffset, qulonglong F
 
         AES_cbc_encrypt(encdata, reinterpret_cast<quint8*>(decdata), BLOCK_SIZE, &_key, static_cast<unsigned char*>(IV), AES_DECRYPT);
         Size -= static_cast<qulonglong>(out->write(decdata + soffset, static_cast<qint64>(WriteSize)));
+        decryptedBytes->add(static_cast<qint64>(WriteSize));
+        progress->add(static_cast<qint64>(WriteSize));
+        blockLatency->record(timer.nsecsElapsed() / 1000);
         Wrote += WriteSize;
 
         if (soffset) {
             WriteSize = BLOCK_SIZE;
             soffset = 0;
         }
-        emit Progress(i1, i2);
     }
 
     out->close();
@@ -199,6 +256,7 @@ void CemuCrypto::ExtractFile(QFile * in, qulonglong PartDataOffset, qulonglong F
 
 qint32 CemuCrypto::Decrypt()
 {
+    TRACE_SPAN("decrypt", "title");
     quint32 TMDLen;
     char* TMD = ReadFile(QDir(Directory).filePath("tmd"), &TMDLen);
     if (TMD == nullptr)
@@ -323,6 +381,17 @@ qint32 CemuCrypto::Decrypt(char* TMD, const char* TIK, const QString& basedir)
 
     qint32 level = 0;
 
+    //the fst lists every size up front, so progress can count bytes
+    qint64 totalSize = 0;
+    for (quint32 i = 1; i < Entries; ++i)
+    {
+        if (!(fe[i].u1.s1.Type & 1) && !(fe[i].u1.s1.Type & 0x80))
+        {
+            totalSize += bs32(fe[i].u2.s2.FileLength);
+        }
+    }
+    progress->setTotal(totalSize);
+
     emit Started();
     for (quint32 i = 1; i < Entries; ++i)
     {
@@ -394,22 +463,22 @@ qint32 CemuCrypto::Decrypt(char* TMD, const char* TIK, const QString& basedir)
                 {
                     if (!outputFile.exists() || outputFile.size() != sz)
                     {
-                        ExtractFileHash(in, 0, CNTOff, sz, output, bs16(fei.ContentID), static_cast<int>(i), static_cast<int>(Entries - 1));
+                        ExtractFileHash(in, 0, CNTOff, sz, output, bs16(fei.ContentID));
                     }
                     else
                     {
-                        emit Progress(static_cast<int>(i), static_cast<int>(Entries - 1));
+                        progress->add(sz);
                     }
                 }
                 else
                 {
                     if (!outputFile.exists() || outputFile.size() != sz)
                     {
-                        ExtractFile(in, 0, CNTOff, sz, output, bs16(fei.ContentID), static_cast<int>(i), static_cast<int>(Entries - 1));
+                        ExtractFile(in, 0, CNTOff, sz, output, bs16(fei.ContentID));
                     }
                     else
                     {
-                        emit Progress(static_cast<int>(i), static_cast<int>(Entries - 1));
+                        progress->add(sz);
                     }
                 }
                 in->close();
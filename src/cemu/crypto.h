@@ -8,6 +8,8 @@
 #include <QDir>
 #include <QFile>
 #include <QDataStream>
+#include <memory>
+#include "progress.h"
 
 #include <openssl\aes.h>
 #include <openssl\sha.h>
@@ -30,13 +32,18 @@ public:
     static quint32 bs32(quint32 s);
     static qulonglong bs64(qulonglong i);
 
+    //decrypts a hex title key with the common key selected by the tmd issuer
+    static QByteArray DecryptTitleKey(const char* tmd, const QString& titleKey);
+
     QString Directory;
     QString TitleKey;
 
+    //counts decrypted bytes, Start creates one when the caller did not
+    std::shared_ptr<ProgressTracker> progress;
+
 signals:
     void Started();
     void Finished();
-    void Progress(int min, int max);
 
 private:
     AES_KEY _key{};
@@ -44,12 +51,9 @@ private:
     quint8 dec_title_key[16]{};
     quint8 title_id[16]{};
 
-    qulonglong H0Count = 0;
-    qulonglong H0Fail = 0;
-
     char* ReadFile(const QString& file, quint32* len);
-    void ExtractFileHash(QFile* in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID, int i1, int i2);
-    void ExtractFile(QFile* in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID, int i1, int i2);
+    void ExtractFileHash(QFile* in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID);
+    void ExtractFile(QFile* in, qulonglong PartDataOffset, qulonglong FileOffset, qulonglong Size, const QString& FileName, quint16 ContentID);
 
     qint32 Decrypt();
     qint32 Decrypt(char* qtmd, const char* qcetk, const QString& basedir);
@@ -61,6 +65,7 @@ public:
     enum ContentType
     {
         CONTENT_REQUIRED = (1 << 0),            // not sure
+        CONTENT_HASHED = (1 << 1),
         CONTENT_SHARED = (1 << 15),
         CONTENT_OPTIONAL = (1 << 14),
     };
@@ -1,8 +1,17 @@
+#include <QSaveFile>
 #include "cemu/database.h"
+#include "trace.h"
 
 CemuDatabase *CemuDatabase::instance = new CemuDatabase;
 
-CemuDatabase::CemuDatabase() = default;
+const char *CemuDatabase::DefaultCdn = "http://ccs.cdn.wup.shop.nintendo.net/ccs/download/";
+
+const char *CemuDatabase::DefaultDatabase = "https://pixxy.in/mapleseed/titlekeys.json";
+
+CemuDatabase::CemuDatabase() : store(std::make_shared<const TitleStore>())
+{
+    connect(&refreshTimer, &QTimer::timeout, this, &CemuDatabase::refresh);
+}
 
 CemuDatabase* CemuDatabase::initialize()
 {
@@ -16,6 +25,13 @@ CemuDatabase* CemuDatabase::initialize()
     QString jsonpath(Settings::value("cemu/database").toString());
     instance->init(jsonpath);
 
+    //database/refresh is the number of hours between checks, 0 turns it off
+    int hours = Settings::value("database/refresh", 24).toInt();
+    if (hours > 0)
+    {
+        instance->refreshTimer.start(hours * 60 * 60 * 1000);
+    }
+
     return instance;
 }
 
@@ -32,99 +48,332 @@ void CemuDatabase::init(QString jsonpath)
     auto qfileinfo = QFileInfo(jsonpath);
     if (!qfileinfo.exists() || qfileinfo.size() == 0)
     {
-        DownloadFile(QUrl("https://pixxy.in/mapleseed/titlekeys.json"), jsonpath);
+        DownloadFile(QUrl(Settings::value("database/url", DefaultDatabase).toString()), jsonpath);
     }
+    this->jsonpath = jsonpath;
 
-    QFile qfile(jsonpath);
-    if (!qfile.exists() || !qfile.open(QIODevice::ReadOnly))
+    //loading runs on a worker, the indexes are built there too and the
+    //window only hears about the versions it publishes
+    loading = true;
+    QtConcurrent::run([this, jsonpath]
     {
-        qCritical() << qfile.errorString();
+        DatabaseSnapshot snapshot;
+        if (snapshot.open(jsonpath))
+        {
+            TRACE_SPAN("database", "load snapshot");
+            QVector<TitleInfo> titles;
+            titles.reserve(snapshot.count());
+            for (int i = 0; i < snapshot.count(); i++)
+            {
+                titles.append(snapshot.at(i));
+            }
+            snapshot.close();
+
+            QMutexLocker locker(&writer);
+            auto next = std::make_shared<TitleStore>();
+            apply(next.get(), titles);
+            publish(next);
+            locker.unlock();
+            qDebug() << "initialized" << current()->count() << "database entries from snapshot";
+            loading = false;
+            emit OnLoadComplete();
+            return;
+        }
+
+        //parsing fills one version of its own and publishes copies of it
+        //as it goes, so the first titles show up long before the file is
+        //done. A copy costs as much as the titles already in it, so one
+        //only goes out each time the count doubled, which keeps the whole
+        //load linear in the size of the file.
+        TRACE_SPAN("database", "parse");
+        QFile qfile(jsonpath);
+        if (!qfile.exists() || !qfile.open(QIODevice::ReadOnly))
+        {
+            qCritical() << qfile.errorString();
+            loading = false;
+            emit OnLoadComplete();
+            return;
+        }
+
+        auto next = std::make_shared<TitleStore>();
+        int published = 0;
+        TitleKeyReader reader;
+        reader.read(&qfile, [this, &next, &published](const QVector<TitleInfo>& batch)
+        {
+            QMutexLocker locker(&writer);
+            apply(next.get(), batch);
+            if (next->count() >= published * 2)
+            {
+                TRACE_SPAN("database", "publish batch");
+                publish(std::make_shared<TitleStore>(*next));
+                published = next->count();
+            }
+            locker.unlock();
+            emit OnBatchLoaded(batch.count());
+        });
+
+        QMutexLocker locker(&writer);
+        publish(next);
+        locker.unlock();
+
+        auto loaded = current();
+        qDebug() << "initialized" << loaded->count() << "database entries";
+        TRACE_SPAN("database", "write snapshot");
+        DatabaseSnapshot::write(jsonpath, *loaded);
+        loading = false;
+        emit OnLoadComplete();
+    });
+}
+
+void CemuDatabase::refresh()
+{
+    //a refresh merged into a half loaded database would be overwritten
+    //by the batches still on their way
+    if (refreshReply || loading || jsonpath.isEmpty())
         return;
+
+    if (!manager)
+    {
+        manager = new QNetworkAccessManager(this);
     }
 
-    QJsonDocument doc = QJsonDocument::fromJson(qfile.readAll());
-    if (doc["titlekeys"].isArray())
+    QNetworkRequest request(QUrl(Settings::value("database/url", DefaultDatabase).toString()));
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    //the validators only describe the file they were sent with
+    auto qfileinfo = QFileInfo(jsonpath);
+    if (qfileinfo.exists() && qfileinfo.size() > 0)
     {
-        QJsonArray array = doc["titlekeys"].toArray();
-        for(auto item : array.toVariantList())
+        auto etag = Settings::value("database/etag").toByteArray();
+        auto modified = Settings::value("database/modified").toByteArray();
+        if (!etag.isEmpty())
         {
-            ParseJsonItem(item);
+            request.setRawHeader("If-None-Match", etag);
+        }
+        if (!modified.isEmpty())
+        {
+            request.setRawHeader("If-Modified-Since", modified);
         }
-        qDebug() << "initialized" << database.count() << "database entries";
-        emit OnLoadComplete();
     }
+
+    qInfo() << "checking for database updates";
+    refreshReply = manager->get(request);
+    connect(refreshReply, &QNetworkReply::finished, this, &CemuDatabase::refreshFinished);
 }
 
-TitleInfo *CemuDatabase::Create(QString xmlpath)
+void CemuDatabase::refreshFinished()
 {
-    QString id = XmlValue(xmlpath, "title_id");
-    TitleInfo *info = find(id);
-    if (info)
+    auto reply = refreshReply;
+    refreshReply = nullptr;
+    reply->deleteLater();
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 304)
+    {
+        qInfo() << "database is up to date";
+        emit OnRefreshComplete(0, 0, 0);
+        return;
+    }
+    if (reply->error() != QNetworkReply::NoError || status != 200)
     {
-        info->XmlPath = xmlpath;
-        return info;
+        qWarning() << "database refresh failed" << status << reply->errorString();
+        emit OnRefreshComplete(0, 0, 0);
+        return;
     }
-    return nullptr;
+
+    QByteArray json(reply->readAll());
+    QByteArray etag(reply->rawHeader("ETag"));
+    QByteArray modified(reply->rawHeader("Last-Modified"));
+    QtConcurrent::run([this, json, etag, modified]
+    {
+        QBuffer buffer;
+        buffer.setData(json);
+        buffer.open(QIODevice::ReadOnly);
+
+        QVector<TitleInfo> titles;
+        TitleKeyReader reader;
+        bool ok = reader.read(&buffer, [&titles](const QVector<TitleInfo>& batch)
+        {
+            titles += batch;
+        });
+
+        if (!ok || titles.isEmpty())
+        {
+            qWarning() << "database refresh returned an unreadable file";
+            emit OnRefreshComplete(0, 0, 0);
+            return;
+        }
+
+        //only remember the validators once the file they describe is kept
+        merge(titles, json);
+        Settings::setValue("database/etag", etag);
+        Settings::setValue("database/modified", modified);
+    });
 }
 
-QString CemuDatabase::XmlValue(const QFileInfo &metaxml, const QString &field)
+void CemuDatabase::merge(const QVector<TitleInfo>& titles, const QByteArray& json)
 {
-    QString value;
-    if (QFile(metaxml.filePath()).exists())
+    TRACE_SPAN("database", "merge refresh");
+    QSet<quint64> upstream;
+    upstream.reserve(titles.count());
+    for (const auto& info : titles)
     {
-        QDomDocument doc;
-        QFile file(metaxml.filePath());
-        if (!file.open(QIODevice::ReadOnly) || !doc.setContent(&file))
-            return nullptr;
+        if (!info.id().isEmpty() && !info.key().isEmpty())
+        {
+            upstream.insert(info.titleId());
+        }
+    }
 
-        QDomNodeList rates = doc.elementsByTagName("menu");
-        for (int i = 0; i < rates.size(); i++)
+    //lookups keep answering from the old version until the merged one
+    //is published
+    QMutexLocker locker(&writer);
+    QVector<const TitleInfo*> gone;
+    store->forEach([&upstream, &gone](const TitleInfo *info)
+    {
+        if (!upstream.contains(info->titleId()))
         {
-            QDomNode n = rates.item(i);
-            QDomElement element = n.firstChildElement(field);
-            if (element.isNull())
-                continue;
-            value = element.text();
+            gone.append(info);
         }
+    });
+
+    auto next = std::make_shared<TitleStore>(*store);
+    for (auto info : gone)
+    {
+        next->remove(info);
     }
-    return value;
+
+    int removed = gone.count();
+    int changed = 0;
+    int added = apply(next.get(), titles, &changed);
+    if (added || changed || removed)
+    {
+        publish(next);
+    }
+    locker.unlock();
+
+    QSaveFile qfile(jsonpath);
+    if (!qfile.open(QIODevice::WriteOnly) || qfile.write(json) != json.size() || !qfile.commit())
+    {
+        qWarning() << "could not save the database" << qfile.errorString();
+    }
+    else
+    {
+        DatabaseSnapshot::write(jsonpath, *current());
+    }
+
+    qInfo() << "database refreshed," << added << "new," << changed << "changed and" << removed << "removed entries";
+    emit OnRefreshComplete(added, changed, removed);
+}
+
+TitleInfo CemuDatabase::Create(QString xmlpath)
+{
+    return Create(xmlpath, MetaXml::read(xmlpath).titleId);
 }
 
-TitleInfo *CemuDatabase::find(QString id)
+TitleInfo CemuDatabase::Create(const QString& xmlpath, const QString& titleId)
 {
-    auto db = instance->database;
-    if (instance->database.contains(id.toUpper()))
+    //published records are shared by every reader, so the installed
+    //location goes on a copy
+    TitleInfo info;
+    auto record = find(titleId);
+    if (record)
     {
-        return &instance->database[id.toUpper()];
+        info = *record;
+        info.XmlPath = xmlpath;
     }
-    return nullptr;
+    return info;
+}
+
+std::shared_ptr<const TitleStore> CemuDatabase::current()
+{
+    return std::atomic_load(&instance->store);
+}
+
+const TitleInfo *CemuDatabase::find(const QString& id)
+{
+    return find(TitleIndex<const TitleInfo*>::parse(id));
+}
+
+const TitleInfo *CemuDatabase::find(quint64 titleId)
+{
+    return current()->find(titleId);
+}
+
+const TitleInfo *CemuDatabase::findProductCode(const QString& code)
+{
+    return current()->findProductCode(code);
 }
 
-bool CemuDatabase::ValidId(QString id)
+QVector<const TitleInfo*> CemuDatabase::findTitleHigh(quint32 high)
 {
-    auto& db = CemuDatabase::instance->database;
-    if (db.contains(id.toUpper()))
+    return current()->findTitleHigh(high);
+}
+
+bool CemuDatabase::ValidId(const QString& id)
+{
+    return find(id) != nullptr;
+}
+
+TitleFamily CemuDatabase::family(quint64 titleId)
+{
+    return current()->family(titleId);
+}
+
+QVector<quint64> CemuDatabase::search(const QString& text, int limit)
+{
+    return current()->search(text, limit);
+}
+
+int CemuDatabase::apply(TitleStore *next, const QVector<TitleInfo>& titles, int *changed)
+{
+    next->reserve(next->count() + titles.count());
+
+    int added = 0;
+    for (const auto& info : titles)
     {
-        return true;
+        if (info.id().isEmpty() || info.key().isEmpty())
+            continue;
+
+        //untouched records are skipped so a refresh only counts changes
+        auto existing = next->find(info.titleId());
+        if (existing && existing->sameRecord(info))
+            continue;
+
+        if (!existing)
+        {
+            added++;
+        }
+        else if (changed)
+        {
+            (*changed)++;
+        }
+
+        records.push_back(info);
+        next->insert(&records.back());
     }
-    return false;
+    return added;
+}
+
+void CemuDatabase::publish(const std::shared_ptr<TitleStore>& next)
+{
+    next->publish(store->version() + 1);
+    std::atomic_store(&store, std::shared_ptr<const TitleStore>(next));
 }
 
-void CemuDatabase::ParseJsonItem(QVariant &item)
+QString CemuDatabase::CdnUrl()
 {
-    QString id(item.toMap()["id"].toString());
-    QString key(item.toMap()["key"].toString());
-    if (!id.isEmpty() && !key.isEmpty())
+    QString url(Settings::value("download/cdn", DefaultCdn).toString());
+    if (!url.endsWith('/'))
     {
-        database[id] = item.toMap();
-        emit OnNewEntry(&database[id]);
+        url += '/';
     }
+    return url;
 }
 
 char *CemuDatabase::DownloadTMD(QString id, QString ver, QString dir)
 {
     QString tmdpath(dir + "/tmd");
-    QString tmdurl("http://ccs.cdn.wup.shop.nintendo.net/ccs/download/" + id + "/tmd");
+    QString tmdurl(CdnUrl() + id + "/tmd");
     if (!ver.isEmpty()){
         tmdurl += "." + ver;
     }
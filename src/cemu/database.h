@@ -10,11 +10,20 @@
 #include <QtXml>
 #include <QtConcurrent>
 #include <QMap>
+#include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QTimer>
+#include <atomic>
+#include <deque>
+#include <memory>
 
 #include "../titleinfo.h"
 #include "../settings.h"
+#include "metaxml.h"
+#include "snapshot.h"
+#include "titlekeyreader.h"
+#include "titlestore.h"
 
 class CemuDatabase : public QObject
 {
@@ -26,15 +35,42 @@ public:
 
     void init(QString jsonpath);
 
-    void ParseJsonItem(QVariant &item);
+    //asks the server for a newer titlekeys.json, sending the validators of
+    //the copy on disk so an unchanged database costs a single 304
+    void refresh();
 
-    static TitleInfo *Create(QString xmlpath);
+    //copy of the database record for an installed title, pointing at its
+    //meta.xml, or a record without an id when the title is unknown
+    static TitleInfo Create(QString xmlpath);
 
-    static QString XmlValue(const QFileInfo &metaxml, const QString &field);
+    //same, for a title id the caller already read from the meta.xml
+    static TitleInfo Create(const QString& xmlpath, const QString& titleId);
 
-    static TitleInfo *find(QString id);
+    //the version readers should use, callers making several lookups that
+    //must agree with each other hold on to one version for all of them
+    static std::shared_ptr<const TitleStore> current();
 
-    static bool ValidId(QString id);
+    static const TitleInfo *find(const QString& id);
+
+    static const TitleInfo *find(quint64 titleId);
+
+    //game carrying the four character product code, e.g. ALZE
+    static const TitleInfo *findProductCode(const QString& code);
+
+    //every title sharing the upper half of the id, e.g. all updates
+    static QVector<const TitleInfo*> findTitleHigh(quint32 high);
+
+    static bool ValidId(const QString& id);
+
+    //game, demo, update and dlc related to a title
+    static TitleFamily family(quint64 titleId);
+
+    //ids of the titles matching a search, best match first
+    static QVector<quint64> search(const QString& text, int limit = -1);
+
+    //base url of the content server, download/cdn in the settings
+    //overrides it so downloads can be pointed at a mirror or a local server
+    static QString CdnUrl();
 
     static char *DownloadTMD(QString id, QString ver, QString dir);
 
@@ -46,11 +82,39 @@ public:
 
     static CemuDatabase *instance;
 
-    QMap<QString, TitleInfo> database;
+    static const char *DefaultCdn;
+
+    static const char *DefaultDatabase;
+
+private:
+    //adds the titles that are new or differ to a version being built and
+    //returns how many of them were new, callers hold the writer lock
+    int apply(TitleStore *next, const QVector<TitleInfo>& titles, int *changed = nullptr);
+
+    //makes a version the current one, callers hold the writer lock
+    void publish(const std::shared_ptr<TitleStore>& next);
+    void refreshFinished();
+    void merge(const QVector<TitleInfo>& titles, const QByteArray& json);
+
+    QString jsonpath;
+    QNetworkAccessManager *manager = nullptr;
+    QNetworkReply *refreshReply = nullptr;
+    std::atomic<bool> loading { false };
+    QTimer refreshTimer;
+
+    std::shared_ptr<const TitleStore> store;
+
+    //writers take turns, records only ever get appended and a deque never
+    //moves them, so pointers handed out stay valid for good. Records a
+    //refresh replaced or dropped are kept for that reason, a refresh only
+    //appends the titles that changed upstream.
+    QMutex writer;
+    std::deque<TitleInfo> records;
 
 signals:
-    void OnNewEntry(TitleInfo *titleInfo);
+    void OnBatchLoaded(int count);
     void OnLoadComplete();
+    void OnRefreshComplete(int added, int changed, int removed);
 
 public slots:
 };
@@ -1,8 +1,20 @@
 #include "library.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace
+{
+    Counter *const scannedTitles = Metrics::counter("library_titles_scanned_total", "Library directories looked at by a scan or a change.");
+    Histogram *const titleLatency = Metrics::histogram("library_title_us", "Time to look up one library directory, in microseconds.");
+}
 
 CemuLibrary *CemuLibrary::instance = new CemuLibrary;
 
-CemuLibrary::CemuLibrary() = default;
+CemuLibrary::CemuLibrary()
+{
+    settleTimer.setSingleShot(true);
+    connect(&settleTimer, &QTimer::timeout, this, &CemuLibrary::processChanges);
+}
 
 CemuLibrary *CemuLibrary::initialize()
 {
@@ -21,13 +33,17 @@ CemuLibrary *CemuLibrary::initialize()
 
 void CemuLibrary::init(QString directory)
 {
+    TRACE_SPAN("library", "scan");
     qDebug() << "initializing library";
     if (directory.isEmpty())
     {
         directory = QDir(".").absolutePath();
     }
 
-    library.clear();
+    //a rescan runs on a worker, the entries are dropped on the gui thread
+    //before any of the new ones arrive there
+    QMetaObject::invokeMethod(this, [this] { clear(); },
+                              thread() == QThread::currentThread() ? Qt::DirectConnection : Qt::BlockingQueuedConnection);
     if (!directory.isEmpty())
     {
         if (QDir(directory).exists())
@@ -40,43 +56,202 @@ void CemuLibrary::init(QString directory)
         }
     }
 
-    QStringList list(QDir(directory).entryList());
+    //titles whose directory and meta.xml did not change since the last
+    //scan come straight from the cache instead of being parsed again
+    cache.load(LibraryCache::path());
+
+    QStringList list;
+    for (const auto& entry : QDir(directory).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        list.append(entry.absoluteFilePath());
+    }
     QtConcurrent::blockingMapped(list, &CemuLibrary::processItem);
+
+    cache.save(LibraryCache::path());
+    qDebug() << "scanned" << list.count() << "library directories," << cache.parsed() << "meta.xml files parsed";
+    QMetaObject::invokeMethod(this, [this, directory, list] { watch(directory, list); }, Qt::QueuedConnection);
+}
+
+TitleInfo *CemuLibrary::find(const QString& id)
+{
+    auto key = instance->ids.value(TitleIndex<QString>::parse(id));
+    if (key.isEmpty())
+        return nullptr;
+
+    auto entry = instance->library.find(key);
+    return entry == instance->library.end() ? nullptr : &entry.value();
+}
+
+TitleInfo *CemuLibrary::insert(const TitleInfo& info)
+{
+    auto entry = &library[info.id()];
+    *entry = info;
+    ids.insert(entry->titleId(), info.id());
+    return entry;
+}
+
+void CemuLibrary::remove(const QString& id)
+{
+    library.remove(id);
+    ids.remove(TitleIndex<QString>::parse(id));
+}
+
+void CemuLibrary::clear()
+{
+    library.clear();
+    ids.clear();
 }
 
-TitleInfo *CemuLibrary::find(QString id)
+void CemuLibrary::watch(const QString& directory, const QStringList& list)
 {
-    auto lib = instance->library;
-    if (instance->library.contains(id.toUpper()))
+    if (!watcher)
     {
-        auto info = instance->library.value(id.toUpper());
-        return info;
+        watcher = new QFileSystemWatcher(this);
+        connect(watcher, &QFileSystemWatcher::directoryChanged, this, &CemuLibrary::directoryChanged);
+    }
+    if (!watcher->directories().isEmpty())
+    {
+        watcher->removePaths(watcher->directories());
+    }
+
+    root = directory;
+    titles = list.toSet();
+    watched.clear();
+    watching.clear();
+    changed.clear();
+    settleTimer.stop();
+
+    watcher->addPath(root);
+    for (const auto& title : list)
+    {
+        watchTitle(title);
     }
-    return nullptr;
 }
 
-QString CemuLibrary::XmlValue(const QFileInfo &metaxml, const QString &field)
+void CemuLibrary::watchTitle(const QString& title)
 {
-    QString value;
-    if (QFile(metaxml.filePath()).exists())
+    auto previous = watching.take(title);
+    if (!previous.isEmpty())
     {
-        QDomDocument doc;
-        QFile file(metaxml.filePath());
-        if (!file.open(QIODevice::ReadOnly) || !doc.setContent(&file))
-            return nullptr;
+        watcher->removePath(previous);
+        watched.remove(previous);
+    }
+
+    if (!titles.contains(title))
+        return;
 
-        QDomNodeList rates = doc.elementsByTagName("menu");
-        for (int i = 0; i < rates.size(); i++)
+    //a finished title only changes through its meta.xml, one that is still
+    //being copied is watched as a whole until its meta folder shows up
+    QString meta(QDir(title).filePath("meta"));
+    QString path(QFileInfo(meta).isDir() ? meta : title);
+    if (watcher->addPath(path))
+    {
+        watched.insert(path, title);
+        watching.insert(title, path);
+    }
+}
+
+void CemuLibrary::directoryChanged(const QString& path)
+{
+    if (changed.isEmpty())
+    {
+        pendingSince.start();
+    }
+    changed.insert(path);
+
+    //a copy touches the same directories over and over, waiting for it to
+    //settle turns all of that into one update per title
+    if (pendingSince.elapsed() < MaxSettleDelay)
+    {
+        settleTimer.start(SettleInterval);
+    }
+}
+
+void CemuLibrary::processChanges()
+{
+    if (updating)
+    {
+        settleTimer.start(SettleInterval);
+        return;
+    }
+
+    QSet<QString> paths;
+    paths.swap(changed);
+
+    QStringList list;
+    for (const auto& path : paths)
+    {
+        if (path != root)
+        {
+            if (watched.contains(path))
+            {
+                list.append(watched.value(path));
+            }
+            continue;
+        }
+
+        QSet<QString> current;
+        for (const auto& entry : QDir(root).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot))
+        {
+            current.insert(entry.absoluteFilePath());
+        }
+        for (const auto& title : current - titles)
+        {
+            list.append(title);
+        }
+        for (const auto& title : titles - current)
         {
-            QDomNode n = rates.item(i);
-            QDomElement element = n.firstChildElement(field);
-            if (element.isNull())
-                continue;
-            value = element.text();
+            list.append(title);
         }
+        titles = current;
+    }
+    list.removeDuplicates();
+    if (list.isEmpty())
+        return;
+
+    qDebug() << "library changed," << list.count() << "title directories to update";
+    updating = true;
+    QtConcurrent::run([this, list]
+    {
+        for (const auto& title : list)
+        {
+            update(title);
+        }
+        cache.save(LibraryCache::path());
+
+        QMetaObject::invokeMethod(this, [this, list]
+        {
+            for (const auto& title : list)
+            {
+                watchTitle(title);
+            }
+            updating = false;
+        }, Qt::QueuedConnection);
+    });
+}
+
+void CemuLibrary::update(const QString& title)
+{
+    TRACE_SPAN("library", "update title");
+    QString previous(cache.titleId(title));
+    MetaXml meta;
+    bool exists = cache.lookup(title, &meta);
+    scannedTitles->add();
+    if (!exists)
+    {
+        cache.remove(title);
+    }
+
+    if (!previous.isEmpty() && previous != meta.titleId)
+    {
+        emit OnRemoveEntry(previous);
+    }
+    if (exists)
+    {
+        emit OnNewEntry(QDir(title).filePath("meta/meta.xml"), meta.titleId);
     }
-    return value.toUpper();
 }
+
 #include "cemu/database.h"
 QVariant CemuLibrary::processItem(const QString &d)
 {
@@ -85,13 +260,17 @@ QVariant CemuLibrary::processItem(const QString &d)
     {
         return NULL;
     }
-    QString directory(Settings::value("cemu/library").toString());
 
-    QDir baseDir(QDir(directory).filePath(d));
-    QString metaFile(baseDir.filePath("meta/meta.xml"));
-    if (QFileInfo(metaFile).exists())
+    TRACE_SPAN("library", "title");
+    QElapsedTimer timer;
+    timer.start();
+    MetaXml meta;
+    bool found = self->cache.lookup(d, &meta);
+    scannedTitles->add();
+    titleLatency->record(timer.nsecsElapsed() / 1000);
+    if (found)
     {
-        emit self->OnNewEntry(metaFile);
+        emit self->OnNewEntry(QDir(d).filePath("meta/meta.xml"), meta.titleId);
     }
     return d;
 }
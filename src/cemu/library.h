@@ -9,10 +9,16 @@
 #include <QFileInfo>
 #include <QtXml>
 #include <QtConcurrent>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <QTimer>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include "../titleinfo.h"
 #include "../settings.h"
+#include "librarycache.h"
+#include "titleindex.h"
 
 class CemuLibrary : public QObject
 {
@@ -24,18 +30,53 @@ public:
 
     void init(QString directory);
 
-    static TitleInfo *find(QString id);
+    //the entries are only changed on the gui thread, which is also the
+    //only one that may look them up
+    static TitleInfo *find(const QString& id);
 
-    static QString XmlValue(const QFileInfo &metaxml, const QString &field);
+    TitleInfo *insert(const TitleInfo& info);
+
+    void remove(const QString& id);
 
     static QVariant processItem(const QString &d);
 
     static CemuLibrary *instance;
 
-    QMap<QString, TitleInfo*> library;
+    //changes are handled once the library has been quiet this long, or
+    //after MaxSettleDelay while a large copy keeps it busy
+    static const int SettleInterval = 1000;
+    static const int MaxSettleDelay = 10000;
+
+    QMap<QString, TitleInfo> library;
+
+private:
+    void watch(const QString& directory, const QStringList& titles);
+    void watchTitle(const QString& title);
+    void directoryChanged(const QString& path);
+    void processChanges();
+    void update(const QString& title);
+    void clear();
+
+    //keys into library rather than pointers, which a detach would leave
+    //dangling
+    TitleIndex<QString> ids;
+    LibraryCache cache;
+
+    //the watcher only ever sees the gui thread, the scan reports the
+    //directories it found through watch
+    QFileSystemWatcher *watcher = nullptr;
+    QString root;
+    QSet<QString> titles;
+    QHash<QString, QString> watched;
+    QHash<QString, QString> watching;
+    QSet<QString> changed;
+    QTimer settleTimer;
+    QElapsedTimer pendingSince;
+    bool updating = false;
 
 signals:
-    void OnNewEntry(QString xmlfile);
+    void OnNewEntry(QString xmlfile, QString titleId);
+    void OnRemoveEntry(QString titleId);
 };
 
 #endif // CEMULIBRARY_H
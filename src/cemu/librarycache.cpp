@@ -0,0 +1,160 @@
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include "cemu/librarycache.h"
+#include "metrics.h"
+#include "settings.h"
+
+namespace
+{
+    Counter *const cacheHits = Metrics::counter("library_cache_hits_total", "Library lookups answered from the cache without reading meta.xml.");
+    Counter *const cacheMisses = Metrics::counter("library_cache_misses_total", "Library lookups that had to read meta.xml.");
+}
+
+QString LibraryCache::path()
+{
+    return QDir(Settings::getdirpath()).filePath("library.cache");
+}
+
+bool LibraryCache::load(const QString& filepath)
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    seen.clear();
+    parseCount.store(0);
+
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic, version;
+    qint32 count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != Magic || version != Version || count < 0)
+    {
+        qWarning() << "ignoring invalid library cache" << filepath;
+        return false;
+    }
+
+    entries.reserve(count);
+    for (qint32 i = 0; i < count; i++)
+    {
+        QString directory;
+        Entry entry;
+        stream >> directory >> entry.dirMtime >> entry.xmlMtime >> entry.xmlSize >> entry.hash;
+        stream >> entry.meta.titleId >> entry.meta.titleVersion >> entry.meta.productCode >> entry.meta.names >> entry.meta.iconPath;
+        if (stream.status() != QDataStream::Ok)
+        {
+            qWarning() << "library cache is truncated" << filepath;
+            entries.clear();
+            return false;
+        }
+        entries.insert(directory, entry);
+    }
+    return true;
+}
+
+bool LibraryCache::save(const QString& filepath)
+{
+    QMutexLocker locker(&mutex);
+    QDir().mkpath(QFileInfo(filepath).absolutePath());
+
+    QSaveFile file(filepath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "could not write library cache" << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << Magic << Version << static_cast<qint32>(seen.count());
+    for (auto it = seen.constBegin(); it != seen.constEnd(); ++it)
+    {
+        const auto& entry = it.value();
+        stream << it.key() << entry.dirMtime << entry.xmlMtime << entry.xmlSize << entry.hash;
+        stream << entry.meta.titleId << entry.meta.titleVersion << entry.meta.productCode << entry.meta.names << entry.meta.iconPath;
+    }
+
+    entries = seen;
+    return file.commit();
+}
+
+bool LibraryCache::lookup(const QString& directory, MetaXml *meta)
+{
+    QFileInfo xml(QDir(directory).filePath("meta/meta.xml"));
+    if (!xml.exists())
+        return false;
+
+    Entry entry;
+    entry.dirMtime = QFileInfo(directory).lastModified().toMSecsSinceEpoch();
+    entry.xmlMtime = xml.lastModified().toMSecsSinceEpoch();
+    entry.xmlSize = xml.size();
+
+    mutex.lock();
+    auto cached = entries.constFind(directory);
+    bool known = cached != entries.constEnd();
+    Entry previous = known ? cached.value() : Entry();
+    mutex.unlock();
+
+    if (known && previous.dirMtime == entry.dirMtime && previous.xmlMtime == entry.xmlMtime && previous.xmlSize == entry.xmlSize)
+    {
+        cacheHits->add();
+        entry = previous;
+    }
+    else
+    {
+        cacheMisses->add();
+        QFile file(xml.filePath());
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "could not read" << xml.filePath() << file.errorString();
+            *meta = MetaXml();
+            return false;
+        }
+
+        auto data = file.readAll();
+        entry.hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+        if (known && previous.hash == entry.hash)
+        {
+            entry.meta = previous.meta;
+        }
+        else
+        {
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::ReadOnly);
+            entry.meta = MetaXml::read(&buffer);
+            parseCount.ref();
+        }
+
+        QString icon(xml.dir().filePath("iconTex.tga"));
+        entry.meta.iconPath = QFileInfo(icon).exists() ? icon : QString();
+    }
+
+    mutex.lock();
+    seen.insert(directory, entry);
+    mutex.unlock();
+
+    *meta = entry.meta;
+    return true;
+}
+
+QString LibraryCache::titleId(const QString& directory)
+{
+    QMutexLocker locker(&mutex);
+    return seen.value(directory).meta.titleId;
+}
+
+void LibraryCache::remove(const QString& directory)
+{
+    QMutexLocker locker(&mutex);
+    seen.remove(directory);
+    entries.remove(directory);
+}
@@ -0,0 +1,60 @@
+#ifndef LIBRARYCACHE_H
+#define LIBRARYCACHE_H
+
+#include <QtCore/qglobal.h>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include "metaxml.h"
+
+//Index of the library kept under the settings directory. Every title
+//directory has an entry holding its mtime, the mtime, size and hash of its
+//meta.xml and everything parsed from it. A rescan only stats directories
+//whose timestamps did not move, and a meta.xml that was touched but not
+//changed is recognised by its hash, so it is never parsed again.
+class LibraryCache
+{
+public:
+    struct Entry
+    {
+        qint64 dirMtime = 0;
+        qint64 xmlMtime = 0;
+        qint64 xmlSize = 0;
+        QByteArray hash;
+        MetaXml meta;
+    };
+
+    static QString path();
+
+    //replaces the entries with the ones stored in the file
+    bool load(const QString& filepath);
+
+    //stores the entries looked up since the last load, titles that went
+    //away are dropped that way
+    bool save(const QString& filepath);
+
+    //fields of the meta.xml in a title directory, false when there is no
+    //meta.xml or it can not be read, the directory is then not cached and
+    //is scanned again next time. Safe to call from several threads at once.
+    bool lookup(const QString& directory, MetaXml *meta);
+
+    //title id last seen in a title directory, empty when it had none
+    QString titleId(const QString& directory);
+
+    void remove(const QString& directory);
+
+    int parsed() const { return parseCount.load(); }
+
+    static const quint32 Magic = 0x434C534D; // "MSLC"
+    static const quint32 Version = 2;
+
+private:
+    QMutex mutex;
+    QHash<QString, Entry> entries;
+    QHash<QString, Entry> seen;
+    QAtomicInt parseCount;
+};
+
+#endif // LIBRARYCACHE_H
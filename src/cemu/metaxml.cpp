@@ -0,0 +1,84 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QXmlStreamReader>
+#include <QtDebug>
+#include "cemu/metaxml.h"
+
+QString MetaXml::name(const QString& language) const
+{
+    auto name = names.value(language);
+    if (name.isEmpty())
+    {
+        name = names.value("en");
+    }
+    for (auto it = names.constBegin(); name.isEmpty() && it != names.constEnd(); ++it)
+    {
+        name = it.value();
+    }
+    return name;
+}
+
+MetaXml MetaXml::read(const QString& filepath)
+{
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "could not read" << filepath << file.errorString();
+        return MetaXml();
+    }
+
+    auto meta = read(&file);
+    QString icon(QFileInfo(filepath).dir().filePath("iconTex.tga"));
+    if (meta.isValid() && QFileInfo(icon).exists())
+    {
+        meta.iconPath = icon;
+    }
+    return meta;
+}
+
+MetaXml MetaXml::read(QIODevice *device)
+{
+    MetaXml meta;
+    QXmlStreamReader xml(device);
+    if (!xml.readNextStartElement() || xml.name() != QLatin1String("menu"))
+        return meta;
+
+    //every field is a direct child of menu holding nothing but text
+    while (xml.readNextStartElement())
+    {
+        auto name = xml.name();
+        if (name == QLatin1String("title_id"))
+        {
+            meta.titleId = xml.readElementText().trimmed().toUpper();
+        }
+        else if (name == QLatin1String("title_version"))
+        {
+            meta.titleVersion = xml.readElementText().trimmed().toUInt();
+        }
+        else if (name == QLatin1String("product_code"))
+        {
+            meta.productCode = xml.readElementText().trimmed();
+        }
+        else if (name.startsWith(QLatin1String("longname_")))
+        {
+            auto language = name.mid(9).toString();
+            auto text = xml.readElementText().trimmed();
+            if (!text.isEmpty())
+            {
+                meta.names.insert(language, text);
+            }
+        }
+        else
+        {
+            xml.skipCurrentElement();
+        }
+    }
+
+    if (xml.hasError())
+    {
+        qWarning() << "malformed meta.xml" << xml.errorString();
+        return MetaXml();
+    }
+    return meta;
+}
@@ -0,0 +1,35 @@
+#ifndef METAXML_H
+#define METAXML_H
+
+#include <QtCore/qglobal.h>
+#include <QIODevice>
+#include <QMap>
+#include <QString>
+
+//The fields of a title's meta/meta.xml. The file is read once with a
+//stream reader and every field is picked up on the way, so asking for
+//another one never means parsing the file again.
+struct MetaXml
+{
+    QString titleId;
+    quint32 titleVersion = 0;
+    QString productCode;
+
+    //longname_xx by language code, e.g. "en"
+    QMap<QString, QString> names;
+
+    //iconTex.tga next to the meta.xml, empty when there is none
+    QString iconPath;
+
+    bool isValid() const { return !titleId.isEmpty(); }
+
+    //name in a language, falling back to english and then any name
+    QString name(const QString& language = "en") const;
+
+    static MetaXml read(const QString& filepath);
+
+    //parses the xml alone, without the paths that need its location
+    static MetaXml read(QIODevice *device);
+};
+
+#endif // METAXML_H
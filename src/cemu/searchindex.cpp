@@ -0,0 +1,167 @@
+#include <algorithm>
+#include "cemu/searchindex.h"
+
+void SearchIndex::clear()
+{
+    documents.clear();
+    postings.clear();
+    positions.clear();
+}
+
+QString SearchIndex::normalize(const QString& text)
+{
+    QString normalized(text.toLower());
+    for (auto& ch : normalized)
+    {
+        if (!ch.isLetterOrNumber())
+        {
+            ch = ' ';
+        }
+    }
+    return normalized.simplified();
+}
+
+QVector<quint64> SearchIndex::trigrams(const QString& text)
+{
+    QVector<quint64> grams;
+    QString padded(" " + text + " ");
+    for (int i = 0; i + 2 < padded.size(); i++)
+    {
+        //word boundaries only need the one padding space
+        if (padded[i] == ' ' && padded[i + 1] == ' ')
+            continue;
+
+        auto gram = (static_cast<quint64>(padded[i].unicode()) << 32) |
+                (static_cast<quint64>(padded[i + 1].unicode()) << 16) |
+                static_cast<quint64>(padded[i + 2].unicode());
+        if (!grams.contains(gram))
+        {
+            grams.append(gram);
+        }
+    }
+    return grams;
+}
+
+void SearchIndex::add(const TitleInfo *info)
+{
+    Document document;
+    document.id = info->titleId();
+    document.text = normalize(info->name() + " " + info->productcode() + " " + info->id());
+
+    auto previous = positions.constFind(document.id);
+    if (previous != positions.constEnd())
+    {
+        if (documents[previous.value()].text == document.text)
+            return;
+
+        //the old document stays in its postings but no longer matches
+        documents[previous.value()].id = 0;
+    }
+
+    int index = documents.count();
+    positions[document.id] = index;
+    documents.append(document);
+    for (auto gram : trigrams(document.text))
+    {
+        postings[gram].append(index);
+    }
+}
+
+void SearchIndex::remove(quint64 titleId)
+{
+    auto position = positions.find(titleId);
+    if (position == positions.end())
+        return;
+
+    documents[position.value()].id = 0;
+    positions.erase(position);
+}
+
+QVector<quint64> SearchIndex::query(const QString& text, int limit) const
+{
+    QVector<quint64> results;
+    auto normalized = normalize(text);
+    if (normalized.isEmpty())
+        return results;
+
+    struct Match
+    {
+        int document;
+        int score;
+    };
+    QVector<Match> matches;
+
+    if (normalized.size() < 3)
+    {
+        //a letter or two makes a trigram that only matches a whole word,
+        //so short queries scan the text instead, word starts first
+        QString word(" " + normalized);
+        for (int document = 0; document < documents.count(); document++)
+        {
+            const auto& text = documents[document].text;
+            if (!documents[document].id || !text.contains(normalized))
+                continue;
+
+            matches.append({document, text.startsWith(normalized) || text.contains(word) ? 2 : 1});
+        }
+    }
+    else
+    {
+        auto grams = trigrams(normalized);
+        QVector<quint16> scores(documents.count());
+        QVector<int> candidates;
+        for (auto gram : grams)
+        {
+            auto posting = postings.constFind(gram);
+            if (posting == postings.constEnd())
+                continue;
+
+            for (auto document : posting.value())
+            {
+                if (!scores[document]++)
+                {
+                    candidates.append(document);
+                }
+            }
+        }
+
+        int minimum = qMax(1, (grams.count() + 2) / 3);
+        for (auto document : candidates)
+        {
+            int score = scores[document];
+            if (score < minimum || !documents[document].id)
+                continue;
+
+            //a literal match beats any number of shared trigrams
+            if (documents[document].text.contains(normalized))
+            {
+                score += grams.count();
+            }
+            matches.append({document, score});
+        }
+    }
+
+    auto better = [this](const Match& a, const Match& b)
+    {
+        if (a.score != b.score)
+            return a.score > b.score;
+        return documents[a.document].text.size() < documents[b.document].text.size();
+    };
+
+    if (limit >= 0 && limit < matches.count())
+    {
+        std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(), better);
+        matches.resize(limit);
+    }
+    else
+    {
+        std::sort(matches.begin(), matches.end(), better);
+    }
+
+    results.reserve(matches.count());
+    for (const auto& match : matches)
+    {
+        results.append(documents[match.document].id);
+    }
+    return results;
+}
@@ -0,0 +1,48 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QtCore/qglobal.h>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "../titleinfo.h"
+
+//Trigram index over title names, product codes and ids. Every word is
+//padded with a space on each side before it is cut into trigrams, and a
+//query only has to share a third of its trigrams with a title to be
+//returned, which keeps a mistyped letter from hiding the title being
+//looked for. Queries shorter than a trigram are matched by scanning the
+//text of every title instead.
+class SearchIndex
+{
+public:
+    void clear();
+
+    //indexes a title, or reindexes it when its text changed
+    void add(const TitleInfo *info);
+
+    //stops a title from matching, its postings stay behind unused
+    void remove(quint64 titleId);
+
+    //ids of the matching titles, best match first
+    QVector<quint64> query(const QString& text, int limit = -1) const;
+
+    int count() const { return positions.count(); }
+
+private:
+    struct Document
+    {
+        quint64 id;
+        QString text;
+    };
+
+    static QString normalize(const QString& text);
+    static QVector<quint64> trigrams(const QString& text);
+
+    QVector<Document> documents;
+    QHash<quint64, QVector<int>> postings;
+    QHash<quint64, int> positions;
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,178 @@
+#include <cstring>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QVector>
+#include "cemu/snapshot.h"
+#include "cemu/titlestore.h"
+
+DatabaseSnapshot::~DatabaseSnapshot()
+{
+    close();
+}
+
+QString DatabaseSnapshot::path(const QString& jsonpath)
+{
+    return jsonpath + ".snapshot";
+}
+
+QByteArray DatabaseSnapshot::hashFile(const QString& filepath)
+{
+    QFile json(filepath);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!json.open(QIODevice::ReadOnly) || !hash.addData(&json))
+        return QByteArray();
+    return hash.result();
+}
+
+bool DatabaseSnapshot::open(const QString& jsonpath)
+{
+    close();
+
+    //every string is copied out while the records are read, so one read
+    //of the whole file does what a mapping would, without keeping the
+    //file open for a refresh to trip over
+    QFileInfo json(jsonpath);
+    QFile file(path(jsonpath));
+    if (!json.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    contents = file.readAll();
+    file.close();
+    if (contents.size() < static_cast<int>(sizeof(Header)))
+    {
+        close();
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, contents.constData(), sizeof(header));
+    if (header.magic != Magic || header.version != Version ||
+            static_cast<quint64>(contents.size()) < sizeof(Header) + static_cast<quint64>(header.count) * sizeof(Record))
+    {
+        close();
+        return false;
+    }
+
+    auto mtime = json.lastModified().toMSecsSinceEpoch();
+    if (header.mtime != mtime || header.size != json.size())
+    {
+        //a redownload of the same file only touches the mtime, so compare
+        //contents before throwing the snapshot away
+        auto hash = hashFile(jsonpath);
+        if (hash.size() != static_cast<int>(sizeof(header.hash)) || memcmp(hash.constData(), header.hash, sizeof(header.hash)) != 0)
+        {
+            qInfo() << "database snapshot is out of date";
+            close();
+            return false;
+        }
+
+        header.mtime = mtime;
+        header.size = json.size();
+        QFile patch(file.fileName());
+        if (patch.open(QIODevice::ReadWrite))
+        {
+            patch.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            patch.close();
+        }
+    }
+
+    auto data = contents.constData();
+    auto poolStart = sizeof(Header) + header.count * sizeof(Record);
+    records = reinterpret_cast<const Record*>(data + sizeof(Header));
+    pool = reinterpret_cast<const QChar*>(data + poolStart);
+    poolSize = static_cast<quint32>((contents.size() - static_cast<qint64>(poolStart)) / 2);
+    recordCount = static_cast<int>(header.count);
+    return true;
+}
+
+void DatabaseSnapshot::close()
+{
+    contents.clear();
+    records = nullptr;
+    pool = nullptr;
+    poolSize = 0;
+    recordCount = 0;
+}
+
+int DatabaseSnapshot::count() const
+{
+    return recordCount;
+}
+
+QString DatabaseSnapshot::string(const Record& record, Field field) const
+{
+    auto offset = record.offset[field];
+    auto length = record.length[field];
+    if (!length || offset > poolSize || length > poolSize - offset)
+        return QString();
+    return QString(pool + offset, static_cast<int>(length));
+}
+
+TitleInfo DatabaseSnapshot::at(int index) const
+{
+    const auto& record = records[index];
+    return TitleInfo(string(record, Id), string(record, Key), string(record, Name),
+                     string(record, Region), string(record, ProductCode), string(record, Extra));
+}
+
+bool DatabaseSnapshot::write(const QString& jsonpath, const TitleStore& store)
+{
+    static const char *names[] = { "id", "key", "name", "region", "productcode" };
+
+    QVector<Record> records;
+    QString pool;
+    records.reserve(store.count());
+
+    store.forEach([&records, &pool](const TitleInfo *info)
+    {
+        Record record;
+        auto map = info->toMap();
+        for (int field = Id; field < Extra; field++)
+        {
+            auto value = map.take(names[field]).toString();
+            record.offset[field] = static_cast<quint32>(pool.size());
+            record.length[field] = static_cast<quint32>(value.size());
+            pool += value;
+        }
+
+        //fields the typed columns do not cover survive as a json object
+        QString extra;
+        if (!map.isEmpty())
+        {
+            extra = QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantMap(map)).toJson(QJsonDocument::Compact));
+        }
+        record.offset[Extra] = static_cast<quint32>(pool.size());
+        record.length[Extra] = static_cast<quint32>(extra.size());
+        pool += extra;
+
+        records.append(record);
+    });
+
+    QFileInfo json(jsonpath);
+    auto hash = hashFile(jsonpath);
+    if (hash.size() != 20)
+        return false;
+
+    Header header;
+    header.magic = Magic;
+    header.version = Version;
+    header.mtime = json.lastModified().toMSecsSinceEpoch();
+    header.size = json.size();
+    memcpy(header.hash, hash.constData(), sizeof(header.hash));
+    header.count = static_cast<quint32>(records.count());
+
+    QSaveFile file(path(jsonpath));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "could not write database snapshot" << file.errorString();
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.constData()), records.count() * static_cast<int>(sizeof(Record)));
+    file.write(reinterpret_cast<const char*>(pool.constData()), pool.size() * 2);
+    return file.commit();
+}
@@ -0,0 +1,72 @@
+#ifndef DATABASESNAPSHOT_H
+#define DATABASESNAPSHOT_H
+
+#include <QtCore/qglobal.h>
+#include <QFile>
+#include <QMap>
+
+#include "../titleinfo.h"
+
+class TitleStore;
+
+//Binary copy of titlekeys.json kept next to it as titlekeys.json.snapshot.
+//It holds a header, one fixed size record per title and a pool of UTF-16
+//strings, so loading the database is one read of the file and a copy of
+//each string, with no json to parse. The indexes are still built from
+//the records on the loading thread.
+class DatabaseSnapshot
+{
+public:
+    ~DatabaseSnapshot();
+
+    static QString path(const QString& jsonpath);
+
+    //reads the snapshot if it was built from the current json file, which
+    //is decided by mtime and size and, when those changed, by its hash
+    bool open(const QString& jsonpath);
+
+    void close();
+
+    int count() const;
+
+    //title stored in a record, the fields without a column of their own
+    //are only parsed when something asks for them
+    TitleInfo at(int index) const;
+
+    static bool write(const QString& jsonpath, const TitleStore& store);
+
+    enum Field { Id, Key, Name, Region, ProductCode, Extra, FieldCount };
+
+    static const quint32 Magic = 0x4244534D; // "MSDB"
+    static const quint32 Version = 1;
+
+private:
+#pragma pack(push, 1)
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        qint64 mtime;
+        qint64 size;
+        quint8 hash[20];
+        quint32 count;
+    };
+
+    struct Record
+    {
+        quint32 offset[FieldCount];
+        quint32 length[FieldCount];
+    };
+#pragma pack(pop)
+
+    static QByteArray hashFile(const QString& filepath);
+    QString string(const Record& record, Field field) const;
+
+    QByteArray contents;
+    const Record *records = nullptr;
+    const QChar *pool = nullptr;
+    quint32 poolSize = 0;
+    int recordCount = 0;
+};
+
+#endif // DATABASESNAPSHOT_H
@@ -0,0 +1,189 @@
+#ifndef TITLEINDEX_H
+#define TITLEINDEX_H
+
+#include <QtCore/qglobal.h>
+#include <QString>
+#include <QVector>
+
+//Open addressing hash map from a 64-bit title id to a value. Slots live in
+//one flat array probed linearly, so a lookup is a multiply, a shift and
+//usually a single cache line, and never allocates. Id 0 is not a valid
+//title and marks an empty slot.
+template <typename T>
+class TitleIndex
+{
+public:
+    int count() const { return size; }
+
+    bool isEmpty() const { return size == 0; }
+
+    void clear()
+    {
+        table.clear();
+        size = 0;
+    }
+
+    void reserve(int count)
+    {
+        int capacity = 16;
+        while (capacity * 3 < count * 4)
+        {
+            capacity *= 2;
+        }
+        if (capacity > table.size())
+        {
+            rehash(capacity);
+        }
+    }
+
+    void insert(quint64 key, const T& value)
+    {
+        if (!key)
+            return;
+
+        //stay below three quarters full so probe runs stay short
+        if ((size + 1) * 4 > table.size() * 3)
+        {
+            rehash(qMax(16, table.size() * 2));
+        }
+
+        int i = find(key);
+        if (!table[i].key)
+        {
+            table[i].key = key;
+            size++;
+        }
+        table[i].value = value;
+    }
+
+    bool remove(quint64 key)
+    {
+        if (!key || table.isEmpty())
+            return false;
+
+        int i = find(key);
+        if (!table[i].key)
+            return false;
+
+        //shift the rest of the probe run back instead of leaving a tombstone
+        int mask = table.size() - 1;
+        int j = i;
+        forever
+        {
+            j = (j + 1) & mask;
+            if (!table[j].key)
+                break;
+
+            int home = bucket(table[j].key);
+            if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j))
+            {
+                table[i] = table[j];
+                i = j;
+            }
+        }
+        table[i] = Slot();
+        size--;
+        return true;
+    }
+
+    bool contains(quint64 key) const
+    {
+        return key && !table.isEmpty() && table[find(key)].key == key;
+    }
+
+    T value(quint64 key, const T& defaultValue = T()) const
+    {
+        if (!key || table.isEmpty())
+            return defaultValue;
+
+        const auto& slot = table[find(key)];
+        return slot.key == key ? slot.value : defaultValue;
+    }
+
+    template <typename F>
+    void forEach(F function) const
+    {
+        for (const auto& slot : table)
+        {
+            if (slot.key)
+            {
+                function(slot.key, slot.value);
+            }
+        }
+    }
+
+    //parses a 16 digit hexadecimal title id without building a new string,
+    //anything else yields 0
+    static quint64 parse(const QString& id)
+    {
+        if (id.size() != 16)
+            return 0;
+
+        quint64 key = 0;
+        for (auto ch : id)
+        {
+            auto c = ch.unicode();
+            quint64 digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else
+                return 0;
+            key = (key << 4) | digit;
+        }
+        return key;
+    }
+
+private:
+    struct Slot
+    {
+        quint64 key = 0;
+        T value = T();
+    };
+
+    int bucket(quint64 key) const
+    {
+        //fibonacci hashing spreads ids that only differ in a few bits
+        return static_cast<int>((key * Q_UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits)) & (table.size() - 1);
+    }
+
+    int find(quint64 key) const
+    {
+        int mask = table.size() - 1;
+        int i = bucket(key);
+        while (table[i].key && table[i].key != key)
+        {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void rehash(int capacity)
+    {
+        QVector<Slot> old(capacity);
+        old.swap(table);
+        bits = 0;
+        while ((1 << bits) < capacity)
+        {
+            bits++;
+        }
+
+        size = 0;
+        for (const auto& slot : old)
+        {
+            if (slot.key)
+            {
+                insert(slot.key, slot.value);
+            }
+        }
+    }
+
+    QVector<Slot> table;
+    int size = 0;
+    int bits = 0;
+};
+
+#endif // TITLEINDEX_H
@@ -0,0 +1,279 @@
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "cemu/titlekeyreader.h"
+
+TitleKeyReader::TitleKeyReader(int batchSize) : batchSize(qMax(1, batchSize))
+{
+    pending.reserve(this->batchSize);
+}
+
+bool TitleKeyReader::read(QIODevice *device, const BatchCallback& batch)
+{
+    QByteArray chunk(ChunkSize, Qt::Uninitialized);
+    forever
+    {
+        auto len = device->read(chunk.data(), ChunkSize);
+        if (len < 0)
+        {
+            qCritical() << "could not read title keys" << device->errorString();
+            return false;
+        }
+        if (len == 0)
+            break;
+
+        feed(chunk.constData(), len, batch);
+    }
+
+    if (!pending.isEmpty())
+    {
+        batch(pending);
+        pending.clear();
+    }
+    return depth == 0 && !inString;
+}
+
+void TitleKeyReader::feed(const char *data, qint64 len, const BatchCallback& batch)
+{
+    //start of the part of this chunk that belongs to the current object
+    qint64 start = object.isEmpty() ? -1 : 0;
+
+    for (qint64 i = 0; i < len; i++)
+    {
+        auto c = data[i];
+        if (inString)
+        {
+            if (escaped)
+            {
+                escaped = false;
+            }
+            else if (c == '\\')
+            {
+                escaped = true;
+            }
+            else if (c == '"')
+            {
+                inString = false;
+                continue;
+            }
+
+            if (depth == 1)
+            {
+                key.append(c);
+            }
+            continue;
+        }
+
+        switch (c)
+        {
+        case '"':
+            inString = true;
+            if (depth == 1)
+            {
+                key.clear();
+            }
+            break;
+
+        case ':':
+            if (depth == 1)
+            {
+                lastKey = key;
+            }
+            break;
+
+        case '[':
+            //older databases are a bare array of titles
+            if ((depth == 1 && lastKey == "titlekeys") || depth == 0)
+            {
+                arrayDepth = depth + 1;
+            }
+            depth++;
+            break;
+
+        case '{':
+            if (depth == arrayDepth && start < 0)
+            {
+                start = i;
+            }
+            depth++;
+            break;
+
+        case '}':
+            depth--;
+            if (depth == arrayDepth && start >= 0)
+            {
+                object.append(data + start, static_cast<int>(i - start + 1));
+                start = -1;
+                record(batch);
+            }
+            break;
+
+        case ']':
+            depth--;
+            if (depth + 1 == arrayDepth)
+            {
+                arrayDepth = -1;
+            }
+            break;
+        }
+    }
+
+    if (start >= 0)
+    {
+        object.append(data + start, static_cast<int>(len - start));
+    }
+}
+
+void TitleKeyReader::record(const BatchCallback& batch)
+{
+    QMap<QString, QVariant> map;
+    if (!parseObject(object, &map))
+    {
+        //nested values are rare enough to leave to the full parser
+        map = QJsonDocument::fromJson(object).object().toVariantMap();
+    }
+    object.clear();
+
+    pending.append(TitleInfo(map));
+    total++;
+    if (pending.count() >= batchSize)
+    {
+        batch(pending);
+        pending.clear();
+    }
+}
+
+static void skipSpace(const QByteArray& data, int& pos)
+{
+    while (pos < data.size() && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n'))
+    {
+        pos++;
+    }
+}
+
+static bool parseString(const QByteArray& data, int& pos, QString *out)
+{
+    if (pos >= data.size() || data[pos] != '"')
+        return false;
+
+    out->clear();
+    int run = ++pos;
+    while (pos < data.size())
+    {
+        auto c = data[pos];
+        if (c == '"')
+        {
+            out->append(QString::fromUtf8(data.constData() + run, pos - run));
+            pos++;
+            return true;
+        }
+        if (c != '\\')
+        {
+            pos++;
+            continue;
+        }
+
+        out->append(QString::fromUtf8(data.constData() + run, pos - run));
+        if (++pos >= data.size())
+            return false;
+
+        switch (data[pos])
+        {
+        case 'b': out->append('\b'); break;
+        case 'f': out->append('\f'); break;
+        case 'n': out->append('\n'); break;
+        case 'r': out->append('\r'); break;
+        case 't': out->append('\t'); break;
+        case 'u':
+        {
+            if (pos + 4 >= data.size())
+                return false;
+            bool ok = false;
+            auto code = data.mid(pos + 1, 4).toUShort(&ok, 16);
+            if (!ok)
+                return false;
+            out->append(QChar(code));
+            pos += 4;
+            break;
+        }
+        default:
+            out->append(QChar(data[pos]));
+            break;
+        }
+        run = ++pos;
+    }
+    return false;
+}
+
+bool TitleKeyReader::parseObject(const QByteArray& object, QMap<QString, QVariant> *map)
+{
+    int pos = 0;
+    skipSpace(object, pos);
+    if (pos >= object.size() || object[pos++] != '{')
+        return false;
+
+    QString name;
+    QString text;
+    forever
+    {
+        skipSpace(object, pos);
+        if (pos < object.size() && object[pos] == '}')
+            return true;
+
+        if (!parseString(object, pos, &name))
+            return false;
+
+        skipSpace(object, pos);
+        if (pos >= object.size() || object[pos++] != ':')
+            return false;
+
+        skipSpace(object, pos);
+        if (pos >= object.size())
+            return false;
+
+        auto c = object[pos];
+        if (c == '"')
+        {
+            if (!parseString(object, pos, &text))
+                return false;
+            map->insert(name, text);
+        }
+        else if (c == '{' || c == '[')
+        {
+            return false;
+        }
+        else
+        {
+            int end = pos;
+            while (end < object.size() && object[end] != ',' && object[end] != '}' &&
+                   object[end] != ' ' && object[end] != '\r' && object[end] != '\n' && object[end] != '\t')
+            {
+                end++;
+            }
+
+            auto literal = object.mid(pos, end - pos);
+            pos = end;
+            if (literal == "true" || literal == "false")
+            {
+                map->insert(name, literal == "true");
+            }
+            else if (literal == "null")
+            {
+                map->insert(name, QVariant());
+            }
+            else
+            {
+                bool ok = false;
+                auto number = literal.toDouble(&ok);
+                if (!ok)
+                    return false;
+                map->insert(name, number);
+            }
+        }
+
+        skipSpace(object, pos);
+        if (pos < object.size() && object[pos] == ',')
+        {
+            pos++;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef TITLEKEYREADER_H
+#define TITLEKEYREADER_H
+
+#include <QtCore/qglobal.h>
+#include <QIODevice>
+#include <QVector>
+#include <functional>
+
+#include "../titleinfo.h"
+
+//Streaming reader for titlekeys.json. The file is scanned a chunk at a
+//time for the objects inside the top level "titlekeys" array and each one
+//becomes a TitleInfo as soon as its closing brace arrives, so only the
+//records themselves and a single chunk are ever held in memory.
+class TitleKeyReader
+{
+public:
+    typedef std::function<void(const QVector<TitleInfo>& batch)> BatchCallback;
+
+    explicit TitleKeyReader(int batchSize = 1000);
+
+    //reads the whole device, calling batch for every batchSize titles
+    //and once more for whatever is left at the end
+    bool read(QIODevice *device, const BatchCallback& batch);
+
+    //parses one json object holding only scalar values, false when it
+    //contains nested values or is malformed
+    static bool parseObject(const QByteArray& object, QMap<QString, QVariant> *map);
+
+    int count() const { return total; }
+
+    static const int ChunkSize = 64 * 1024;
+
+private:
+    void feed(const char *data, qint64 len, const BatchCallback& batch);
+    void record(const BatchCallback& batch);
+
+    int batchSize;
+    QVector<TitleInfo> pending;
+    int total = 0;
+
+    //scanner state carried across chunks
+    int depth = 0;
+    int arrayDepth = -1;
+    bool inString = false;
+    bool escaped = false;
+    QByteArray key;
+    QByteArray lastKey;
+    QByteArray object;
+};
+
+#endif // TITLEKEYREADER_H
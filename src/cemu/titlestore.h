@@ -0,0 +1,146 @@
+#ifndef TITLESTORE_H
+#define TITLESTORE_H
+
+#include <QtCore/qglobal.h>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "../titleinfo.h"
+#include "searchindex.h"
+#include "titleindex.h"
+
+//One published version of the database with every index built over it.
+//A version is never changed after it is published: a writer copies the
+//current one, adds or drops records in the copy and publishes that in its
+//place. The copy shares the containers at first, but the first insert
+//detaches every index, so a new version costs time linear in the size of
+//the database and writers batch their records accordingly. Readers keep
+//using whichever version they loaded, so they never wait on a writer. The
+//records themselves are owned by the database and outlive every version
+//that points at them.
+class TitleStore
+{
+public:
+    quint64 version() const { return number; }
+
+    int count() const { return ids.count(); }
+
+    const TitleInfo *find(quint64 titleId) const
+    {
+        return ids.value(titleId, nullptr);
+    }
+
+    const TitleInfo *findProductCode(const QString& code) const
+    {
+        return productCodes.value(code.right(4).toUpper(), nullptr);
+    }
+
+    QVector<const TitleInfo*> findTitleHigh(quint32 high) const
+    {
+        return titleHighs.value(high);
+    }
+
+    TitleFamily family(quint64 titleId) const
+    {
+        return families.value(TitleFamily::key(titleId));
+    }
+
+    QVector<quint64> search(const QString& text, int limit = -1) const
+    {
+        return searchIndex.query(text, limit);
+    }
+
+    template <typename F>
+    void forEach(F function) const
+    {
+        ids.forEach([&function](quint64, const TitleInfo *info) { function(info); });
+    }
+
+    //the following are only for the writer building the next version
+
+    void reserve(int count)
+    {
+        ids.reserve(count);
+    }
+
+    //indexes a record, taking the place of an older one with the same id
+    void insert(const TitleInfo *entry)
+    {
+        auto previous = find(entry->titleId());
+        ids.insert(entry->titleId(), entry);
+
+        auto& high = titleHighs[static_cast<quint32>(entry->titleId() >> 32)];
+        int index = previous ? high.indexOf(previous) : -1;
+        if (index < 0)
+        {
+            high.append(entry);
+        }
+        else
+        {
+            high[index] = entry;
+        }
+        searchIndex.add(entry);
+
+        auto key = TitleFamily::key(entry->titleId());
+        auto related = families.value(key);
+        related.set(entry);
+        families.insert(key, related);
+
+        if (entry->titleType() == TitleType::Game && !entry->productcode().isEmpty())
+        {
+            productCodes.insert(entry->productcode().right(4).toUpper(), entry);
+        }
+    }
+
+    //drops a record from every index, for titles gone upstream
+    void remove(const TitleInfo *entry)
+    {
+        if (!ids.remove(entry->titleId()))
+            return;
+
+        auto high = titleHighs.find(static_cast<quint32>(entry->titleId() >> 32));
+        if (high != titleHighs.end())
+        {
+            high->removeOne(entry);
+            if (high->isEmpty())
+            {
+                titleHighs.erase(high);
+            }
+        }
+        searchIndex.remove(entry->titleId());
+
+        auto key = TitleFamily::key(entry->titleId());
+        auto related = families.value(key);
+        related.unset(entry);
+        if (related.isEmpty())
+        {
+            families.remove(key);
+        }
+        else
+        {
+            families.insert(key, related);
+        }
+
+        auto product = productCodes.find(entry->productcode().right(4).toUpper());
+        if (product != productCodes.end() && product.value() == entry)
+        {
+            productCodes.erase(product);
+        }
+    }
+
+    void publish(quint64 version)
+    {
+        number = version;
+    }
+
+private:
+    quint64 number = 0;
+    TitleIndex<const TitleInfo*> ids;
+    QHash<QString, const TitleInfo*> productCodes;
+    QHash<quint32, QVector<const TitleInfo*>> titleHighs;
+    TitleIndex<TitleFamily> families;
+    SearchIndex searchIndex;
+};
+
+#endif // TITLESTORE_H
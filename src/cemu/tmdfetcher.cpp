@@ -0,0 +1,177 @@
+#include <cstddef>
+#include <QDateTime>
+#include <QDir>
+#include "cemu/tmdfetcher.h"
+#include "cemu/crypto.h"
+#include "cemu/database.h"
+#include "metrics.h"
+
+namespace
+{
+    Counter *const cacheHits = Metrics::counter("tmd_cache_hits_total", "TMD requests answered from memory or disk.");
+    Counter *const cacheMisses = Metrics::counter("tmd_cache_misses_total", "TMD requests that went to the network.");
+}
+
+TmdFetcher *TmdFetcher::instance = new TmdFetcher;
+
+TmdFetcher::TmdFetcher() = default;
+
+TmdFetcher *TmdFetcher::initialize()
+{
+    if (!instance)
+    {
+        instance = new TmdFetcher;
+    }
+    return instance;
+}
+
+QString TmdFetcher::cacheKey(const QString& id, const QString& version)
+{
+    return version.isEmpty() ? id.toUpper() : id.toUpper() + "." + version;
+}
+
+QString TmdFetcher::cachePath(const QString& key) const
+{
+    return QDir(Settings::getdirpath()).filePath("tmd/" + key);
+}
+
+bool TmdFetcher::isValid(const QByteArray& tmd)
+{
+    if (tmd.size() < static_cast<int>(offsetof(CemuCrypto::TitleMetaData, Contents)))
+        return false;
+
+    auto data = reinterpret_cast<const CemuCrypto::TitleMetaData*>(tmd.constData());
+    auto count = CemuCrypto::bs16(data->ContentCount);
+    return data->Version == 1 && count <= 1024 &&
+            tmd.size() >= static_cast<int>(offsetof(CemuCrypto::TitleMetaData, Contents) + count * sizeof(CemuCrypto::Content));
+}
+
+QByteArray TmdFetcher::cached(const QString& id, const QString& version)
+{
+    auto key = cacheKey(id, version);
+
+    QMutexLocker locker(&mutex);
+    if (auto tmd = memory.object(key))
+        return *tmd;
+
+    //the latest version of a title changes with every update, so an
+    //unversioned TMD is only trusted for a day
+    QFileInfo info(cachePath(key));
+    if (!info.exists() || (version.isEmpty() && info.lastModified().secsTo(QDateTime::currentDateTime()) > 24 * 60 * 60))
+        return QByteArray();
+
+    QFile file(info.filePath());
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    auto tmd = file.readAll();
+    if (!isValid(tmd))
+        return QByteArray();
+
+    memory.insert(key, new QByteArray(tmd));
+    return tmd;
+}
+
+void TmdFetcher::request(const QString& id, const QString& version, QObject *context, Callback callback)
+{
+    auto tmd = cached(id, version);
+    if (!tmd.isEmpty())
+    {
+        cacheHits->add();
+        QMetaObject::invokeMethod(context, [=] { callback(tmd); }, Qt::QueuedConnection);
+        return;
+    }
+
+    cacheMisses->add();
+    waiters.insert(cacheKey(id, version), {context, callback});
+    enqueue(id, version);
+}
+
+void TmdFetcher::enqueue(const QString& id, const QString& version)
+{
+    auto key = cacheKey(id, version);
+    if (inflight.contains(key))
+        return;
+
+    inflight.insert(key);
+    pending.enqueue({id.toUpper(), version});
+    QMetaObject::invokeMethod(this, "next", Qt::QueuedConnection);
+}
+
+void TmdFetcher::next()
+{
+    if (!manager)
+    {
+        manager = new QNetworkAccessManager(this);
+    }
+
+    while (running < MaxConcurrent && !pending.isEmpty())
+    {
+        auto title = pending.dequeue();
+        auto key = cacheKey(title.first, title.second);
+
+        //another request may have filled the cache in the meantime
+        auto tmd = cached(title.first, title.second);
+        if (!tmd.isEmpty())
+        {
+            finished(key, tmd);
+            continue;
+        }
+
+        QString tmdurl(CemuDatabase::CdnUrl() + title.first + "/tmd");
+        if (!title.second.isEmpty())
+        {
+            tmdurl += "." + title.second;
+        }
+
+        QNetworkRequest request(tmdurl);
+        request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+        auto reply = manager->get(request);
+        running++;
+
+        connect(reply, &QNetworkReply::finished, this, [=]
+        {
+            running--;
+            reply->deleteLater();
+
+            QByteArray data;
+            if (reply->error() == QNetworkReply::NoError)
+            {
+                data = reply->readAll();
+            }
+            if (!isValid(data))
+            {
+                qWarning() << "could not fetch tmd" << tmdurl << reply->errorString();
+                data.clear();
+            }
+            else
+            {
+                QDir().mkpath(QFileInfo(cachePath(key)).path());
+                QFile file(cachePath(key));
+                if (file.open(QIODevice::WriteOnly))
+                {
+                    file.write(data);
+                    file.close();
+                }
+                QMutexLocker locker(&mutex);
+                memory.insert(key, new QByteArray(data));
+            }
+
+            finished(key, data);
+            next();
+        });
+    }
+}
+
+void TmdFetcher::finished(const QString& key, const QByteArray& tmd)
+{
+    inflight.remove(key);
+    for (const auto& waiter : waiters.values(key))
+    {
+        if (waiter.context)
+        {
+            waiter.callback(tmd);
+        }
+    }
+    waiters.remove(key);
+}
@@ -0,0 +1,71 @@
+#ifndef TMDFETCHER_H
+#define TMDFETCHER_H
+
+#include <QtCore/qglobal.h>
+#include <QObject>
+#include <QtDebug>
+#include <QCache>
+#include <QMutex>
+#include <QPointer>
+#include <QQueue>
+#include <QSet>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <functional>
+
+#include "../settings.h"
+
+//Fetches title metadata for many titles at once without blocking the
+//caller. Requests run through a bounded pool of concurrent replies and
+//every TMD is cached in memory and under the settings directory, so a
+//title only ever costs one round-trip.
+class TmdFetcher : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void(const QByteArray& tmd)> Callback;
+
+    TmdFetcher();
+
+    static TmdFetcher *initialize();
+
+    //invokes callback on the GUI thread once the TMD is available, an
+    //empty array means it could not be fetched
+    void request(const QString& id, const QString& version, QObject *context, Callback callback);
+
+    //returns a cached TMD or an empty array, never touches the network
+    QByteArray cached(const QString& id, const QString& version);
+
+    static bool isValid(const QByteArray& tmd);
+
+    static TmdFetcher *instance;
+
+    static const int MaxConcurrent = 8;
+
+private slots:
+    void next();
+
+private:
+    struct Waiter
+    {
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    static QString cacheKey(const QString& id, const QString& version);
+    QString cachePath(const QString& key) const;
+    void enqueue(const QString& id, const QString& version);
+    void finished(const QString& key, const QByteArray& tmd);
+
+    QNetworkAccessManager *manager = nullptr;
+    QCache<QString, QByteArray> memory{512};
+    QMutex mutex;
+    QQueue<QPair<QString, QString>> pending;
+    QSet<QString> inflight;
+    QMultiHash<QString, Waiter> waiters;
+    int running = 0;
+};
+
+#endif // TMDFETCHER_H
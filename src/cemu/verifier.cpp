@@ -0,0 +1,191 @@
+#include <cstring>
+#include "cemu/verifier.h"
+
+ContentVerifier::ContentVerifier(const QByteArray& titleKey, quint16 index, bool hashed, const QByteArray& hash, const QByteArray& h3)
+    : index(index), hashed(hashed), hash(hash.left(SHA_DIGEST_LENGTH)), h3(h3)
+{
+    AES_set_decrypt_key(reinterpret_cast<const quint8*>(titleKey.constData()), 128, &key);
+
+    iv[0] = static_cast<quint8>(index >> 8);
+    iv[1] = static_cast<quint8>(index);
+    SHA1_Init(&sha);
+
+    scratch.resize(hashed ? BlockSize - HashSize : BlockSize);
+}
+
+void ContentVerifier::reset()
+{
+    pending.clear();
+    offset = 0;
+    memset(iv, 0, sizeof(iv));
+    iv[0] = static_cast<quint8>(index >> 8);
+    iv[1] = static_cast<quint8>(index);
+    SHA1_Init(&sha);
+    clearBadRanges();
+}
+
+void ContentVerifier::update(const char *data, qint64 len)
+{
+    if (hashed)
+    {
+        while (len > 0)
+        {
+            if (pending.isEmpty() && len >= BlockSize)
+            {
+                checkBlock(offset / BlockSize, reinterpret_cast<const quint8*>(data));
+                offset += BlockSize;
+                data += BlockSize;
+                len -= BlockSize;
+                continue;
+            }
+
+            auto take = qMin(static_cast<qint64>(BlockSize - pending.size()), len);
+            pending.append(data, static_cast<int>(take));
+            data += take;
+            len -= take;
+
+            if (pending.size() == BlockSize)
+            {
+                checkBlock(offset / BlockSize, reinterpret_cast<const quint8*>(pending.constData()));
+                offset += BlockSize;
+                pending.clear();
+            }
+        }
+        return;
+    }
+
+    auto out = reinterpret_cast<quint8*>(scratch.data());
+
+    //complete a cipher block left over from the previous call
+    if (!pending.isEmpty())
+    {
+        auto take = qMin(static_cast<qint64>(AES_BLOCK_SIZE - pending.size()), len);
+        pending.append(data, static_cast<int>(take));
+        data += take;
+        len -= take;
+        if (pending.size() < AES_BLOCK_SIZE)
+            return;
+
+        AES_cbc_encrypt(reinterpret_cast<const quint8*>(pending.constData()), out, AES_BLOCK_SIZE, &key, iv, AES_DECRYPT);
+        SHA1_Update(&sha, out, AES_BLOCK_SIZE);
+        pending.clear();
+    }
+
+    while (len >= AES_BLOCK_SIZE)
+    {
+        auto chunk = qMin(static_cast<qint64>(scratch.size()), len & ~static_cast<qint64>(AES_BLOCK_SIZE - 1));
+        AES_cbc_encrypt(reinterpret_cast<const quint8*>(data), out, static_cast<size_t>(chunk), &key, iv, AES_DECRYPT);
+        SHA1_Update(&sha, out, static_cast<size_t>(chunk));
+        data += chunk;
+        len -= chunk;
+    }
+
+    if (len > 0)
+    {
+        pending.append(data, static_cast<int>(len));
+    }
+}
+
+bool ContentVerifier::verifyBlock(qint64 offset, const char *data, qint64 len)
+{
+    if (!hashed || len != BlockSize || offset % BlockSize != 0)
+        return false;
+    return checkBlock(offset / BlockSize, reinterpret_cast<const quint8*>(data));
+}
+
+bool ContentVerifier::finish()
+{
+    if (hashed)
+    {
+        if (!pending.isEmpty())
+        {
+            QMutexLocker locker(&mutex);
+            bad.append({offset, pending.size()});
+            pending.clear();
+        }
+        return badRanges().isEmpty();
+    }
+
+    quint8 digest[SHA_DIGEST_LENGTH];
+    SHA1_Final(digest, &sha);
+    if (!pending.isEmpty())
+        return false;
+    return hash.size() == SHA_DIGEST_LENGTH && memcmp(digest, hash.constData(), SHA_DIGEST_LENGTH) == 0;
+}
+
+QList<QPair<qint64, qint64>> ContentVerifier::badRanges() const
+{
+    QMutexLocker locker(&mutex);
+    return bad;
+}
+
+void ContentVerifier::clearBadRanges()
+{
+    QMutexLocker locker(&mutex);
+    bad.clear();
+}
+
+bool ContentVerifier::verifyH3(const QByteArray& h3, const QByteArray& hash)
+{
+    if (h3.isEmpty() || h3.size() % SHA_DIGEST_LENGTH != 0 || hash.size() < SHA_DIGEST_LENGTH)
+        return false;
+
+    quint8 digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const quint8*>(h3.constData()), static_cast<size_t>(h3.size()), digest);
+    return memcmp(digest, hash.constData(), SHA_DIGEST_LENGTH) == 0;
+}
+
+//mirrors the H0 check in CemuCrypto::ExtractFileHash and additionally
+//walks the H1, H2 and H3 levels of the hash tree
+bool ContentVerifier::checkBlock(qint64 block, const quint8 *data)
+{
+    quint8 hashes[HashSize];
+    quint8 blockIV[16];
+    quint8 digest[SHA_DIGEST_LENGTH];
+    auto out = reinterpret_cast<quint8*>(scratch.data());
+    auto group = static_cast<int>(block & 0xF);
+
+    memset(blockIV, 0, sizeof(blockIV));
+    blockIV[0] = static_cast<quint8>(index >> 8);
+    blockIV[1] = static_cast<quint8>(index);
+    AES_cbc_encrypt(data, hashes, HashSize, &key, blockIV, AES_DECRYPT);
+
+    const quint8 *h0 = hashes + SHA_DIGEST_LENGTH * group;
+    const quint8 *h1 = hashes + 0x140;
+    const quint8 *h2 = hashes + 0x280;
+
+    memcpy(blockIV, h0, sizeof(blockIV));
+    if (group == 0)
+        blockIV[1] ^= static_cast<quint8>(index);
+
+    AES_cbc_encrypt(data + HashSize, out, BlockSize - HashSize, &key, blockIV, AES_DECRYPT);
+    SHA1(out, BlockSize - HashSize, digest);
+    if (group == 0)
+        digest[1] ^= static_cast<quint8>(index);
+
+    bool valid = memcmp(digest, h0, SHA_DIGEST_LENGTH) == 0;
+    if (valid)
+    {
+        SHA1(hashes, 0x140, digest);
+        valid = memcmp(digest, h1 + SHA_DIGEST_LENGTH * ((block >> 4) & 0xF), SHA_DIGEST_LENGTH) == 0;
+    }
+    if (valid)
+    {
+        SHA1(h1, 0x140, digest);
+        valid = memcmp(digest, h2 + SHA_DIGEST_LENGTH * ((block >> 8) & 0xF), SHA_DIGEST_LENGTH) == 0;
+    }
+    if (valid && !h3.isEmpty())
+    {
+        SHA1(h2, 0x140, digest);
+        auto h3Offset = SHA_DIGEST_LENGTH * (block >> 12);
+        valid = h3Offset + SHA_DIGEST_LENGTH <= h3.size() &&
+                memcmp(digest, h3.constData() + h3Offset, SHA_DIGEST_LENGTH) == 0;
+    }
+
+    if (!valid)
+    {
+        QMutexLocker locker(&mutex);
+        bad.append({block * BlockSize, BlockSize});
+    }
+    return valid;
+}
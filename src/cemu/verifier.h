@@ -0,0 +1,68 @@
+#ifndef CONTENTVERIFIER_H
+#define CONTENTVERIFIER_H
+
+#include <QtCore/qglobal.h>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+
+#include <openssl/aes.h>
+#include <openssl/sha.h>
+
+//Verifies encrypted title content while it is being downloaded.
+//Hashed contents are checked block by block against the H0-H2 tables
+//embedded in every 0x10000 block and against the content's .h3 file,
+//so a corrupt block is known as soon as it arrives. Plain contents can
+//only be checked as a whole against the TMD SHA1 once they complete.
+class ContentVerifier
+{
+public:
+    ContentVerifier(const QByteArray& titleKey, quint16 index, bool hashed, const QByteArray& hash, const QByteArray& h3 = QByteArray());
+
+    bool isHashed() const { return hashed; }
+
+    //feeds the next sequential piece of the encrypted content
+    void update(const char *data, qint64 len);
+
+    //verifies a single re-downloaded block of a hashed content
+    bool verifyBlock(qint64 offset, const char *data, qint64 len);
+
+    //discards everything fed so far, used when a transfer restarts
+    void reset();
+
+    //completes verification, true when the content is intact
+    bool finish();
+
+    //ranges of a hashed content that failed verification
+    QList<QPair<qint64, qint64>> badRanges() const;
+
+    void clearBadRanges();
+
+    //true when .h3 matches the hash recorded for it in the TMD
+    static bool verifyH3(const QByteArray& h3, const QByteArray& hash);
+
+    static const int BlockSize = 0x10000;
+    static const int HashSize = 0x400;
+
+private:
+    bool checkBlock(qint64 block, const quint8 *data);
+
+    AES_KEY key{};
+    quint16 index;
+    bool hashed;
+    QByteArray hash;
+    QByteArray h3;
+
+    QByteArray pending;
+    QByteArray scratch;
+    qint64 offset = 0;
+
+    SHA_CTX sha{};
+    quint8 iv[16]{};
+
+    mutable QMutex mutex;
+    QList<QPair<qint64, qint64>> bad;
+};
+
+#endif // CONTENTVERIFIER_H
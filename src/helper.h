@@ -13,6 +13,7 @@
 #include "cemu/library.h"
 #include "cemu/database.h"
 #include "cemu/crypto.h"
+#include "cemu/tmdfetcher.h"
 #include "cemu/QtCompressor.h"
 
 class Helper
@@ -75,55 +76,6 @@ public:
         return QFileInfo();
     }
 
-    static void filter(QString region, QString filter_string, QListWidget *listWidget)
-    {
-        if (!filter_string.isEmpty())
-            qInfo() << "filter:" << filter_string;
-
-        auto all = listWidget->findItems("*", Qt::MatchFlag::MatchWildcard);
-        QtConcurrent::blockingMapped(all, HideListWidgetItem);
-
-        QString searchString;
-        auto matches = QList<QListWidgetItem*>();
-
-        if (filter_string.isEmpty()) {
-            searchString.append("*" + region + "* *");
-            matches = listWidget->findItems(searchString, Qt::MatchFlag::MatchWildcard | Qt::MatchFlag::MatchCaseSensitive);
-        }
-        else {
-            searchString.append("*" + region + "*" + filter_string + "*");
-            matches = listWidget->findItems(searchString, Qt::MatchFlag::MatchWildcard);
-        }
-
-        QtConcurrent::blockingMapped(matches, ShowListWidgetItem);
-    }
-
-    static QListWidgetItem* HideListWidgetItem(QListWidgetItem *item)
-    {
-        if (mutex().tryLock(100))
-        {
-            item->setHidden(true);
-            mutex().unlock();
-        }
-        else {
-            item->setHidden(true);
-        }
-        return item;
-    }
-
-    static QListWidgetItem* ShowListWidgetItem(QListWidgetItem *item)
-    {
-        if (mutex().tryLock(100))
-        {
-            item->setHidden(false);
-            mutex().unlock();
-        }
-        else {
-            item->setHidden(false);
-        }
-        return item;
-    }
-
     static void SelectionChanged(QListWidget* listWidget, QLabel *label)
     {
         auto items = listWidget->selectedItems();
@@ -137,12 +89,6 @@ public:
         label->setPixmap(QPixmap(info->coverArt()));
     }
 
-    static inline QMutex &mutex()
-    {
-        static QMutex mutex;
-        return mutex;
-    }
-
     static QString fomartSize(float size)
     {
         double num = static_cast<double>(size);
@@ -160,49 +106,70 @@ public:
         return QString().setNum(num, 'f', 2) + " " + unit;
     }
 
-    static TitleInfo *findWiiUTitleInfo(QString id)
+    static const TitleInfo *findWiiUTitleInfo(QString id)
     {
-        TitleInfo *info;
-        if ((info = CemuDatabase::find(id))) {
+        //the library copy knows where the title is installed
+        const TitleInfo *info;
+        if ((info = CemuLibrary::find(id)) || (info = CemuDatabase::find(id))) {
             return info;
         }
         return nullptr;
     }
 
-    static QueueInfo *GetWiiuDownloadInfo(QString id, QString version)
+    static QueueInfo *GetWiiuDownloadInfo(QString id, QString version, QByteArray tmdData)
     {
         auto info = Helper::findWiiUTitleInfo(id);
+        if (!info) {
+            return nullptr;
+        }
 
-        QString baseURL("http://ccs.cdn.wup.shop.nintendo.net/ccs/download/");
+        QString baseURL(CemuDatabase::CdnUrl());
         if (info->key().isEmpty() || info->key().length() != 32) {
             qWarning() << "Invalid title key" << info->key();
             return nullptr;
         }
 
+        if (!TmdFetcher::isValid(tmdData)) {
+            qCritical() << "Invalid TMD. Cannot continue!";
+            return nullptr;
+        }
+
         QString directory(info->dir());
         if (!QDir(directory).exists())
         {
             QDir().mkpath(directory);
         }
 
-        auto tmdData = CemuDatabase::DownloadTMD(id, version, directory);
-        auto tmd = reinterpret_cast<CemuCrypto::TitleMetaData*>(tmdData);
-        CemuDatabase::CreateTicket(id, info->key(), version, directory);
-
-        if (!tmd) {
-            qCritical() << "Invalid TMD. Cannot continue!";
-            return nullptr;
+        QFile tmdfile(QDir(directory).filePath("tmd"));
+        if (tmdfile.open(QIODevice::WriteOnly))
+        {
+            tmdfile.write(tmdData);
+            tmdfile.close();
         }
 
+        auto tmd = reinterpret_cast<const CemuCrypto::TitleMetaData*>(tmdData.constData());
+        CemuDatabase::CreateTicket(id, info->key(), version, directory);
+
         auto contentCount = CemuCrypto::bs16(tmd->ContentCount);
         if (contentCount > 1024)
             return nullptr;
 
         auto qinfo = new QueueInfo;
         qinfo->userData = info->key();
+        qinfo->id = info->id();
+        qinfo->version = version;
         qinfo->name = info->formatName();
         qinfo->directory = directory;
         qinfo->totalSize = 0;
+        if (info->titleType() == TitleType::Patch)
+        {
+            //updates are small and usually wanted before anything else
+            qinfo->priority = QueueInfo::High;
+        }
+        if (Settings::value("download/verify", true).toBool())
+        {
+            qinfo->titleKey = CemuCrypto::DecryptTitleKey(tmdData.constData(), info->key());
+        }
         for (int i = 0; i < contentCount; i++)
         {
             QString contentID = QString().sprintf("%08x", CemuCrypto::bs32(tmd->Contents[i].ID));
@@ -211,8 +178,15 @@ public:
             qulonglong size = CemuCrypto::bs64(tmd->Contents[i].Size);
             if (!QFile(contentPath).exists() || QFileInfo(contentPath).size() != static_cast<qint64>(size))
             {
+                QueueContent content;
+                content.filepath = contentPath;
+                content.url = downloadURL;
+                content.size = static_cast<qint64>(size);
+                content.index = CemuCrypto::bs16(tmd->Contents[i].Index);
+                content.hashed = CemuCrypto::bs16(tmd->Contents[i].Type) & CemuCrypto::CONTENT_HASHED;
+                content.hash = QByteArray(reinterpret_cast<const char*>(tmd->Contents[i].SHA2), SHA_DIGEST_LENGTH);
                 qinfo->totalSize += size;
-                qinfo->urls.push_back({contentPath,downloadURL});
+                qinfo->contents.push_back(content);
             }
         }
 
@@ -249,6 +223,7 @@ public:
         saveTo = QDir(saveTo).filePath(tinfo->formatName());
         QDir().mkpath(saveTo);
         saveTo = QDir(saveTo).filePath(id.right(8) + "-" + QDateTime::currentDateTime().toString("MM-dd-yyyy hh.mm.ss AP") + ".qta");
+        compressor->setLevel(Settings::value("backup/level", QtCompressor::DefaultLevel).toInt());
         QtConcurrent::run([=]
         {
             QString savedir = CemuSaveDir(id);
@@ -1,11 +1,11 @@
+#include <cstdio>
 #include "logging.h"
 #include "settings.h"
 
 Logging *Logging::instance;
 
-Logging::Logging(QObject *parent) : QObject(parent)
+Logging::Logging(QObject *parent) : QObject(parent), ring(Capacity)
 {
-    connect(this, &Logging::OnLogEvent, this, &Logging::logEvent);
 }
 
 Logging::~Logging()
@@ -28,10 +28,37 @@ Logging *Logging::initialize()
       return nullptr;
     }
 
+    //the category filter only runs when it is installed, so installing it
+    //again is what makes a change of the debug setting take effect
+    instance->debug = Settings::value("debug").toBool();
+    connect(Settings::instance(), &Settings::changed, instance, [](const QString &key, const QVariant &value)
+    {
+        if (key == "debug")
+        {
+            instance->debug = value.toBool();
+            QLoggingCategory::installFilter(Logging::categoryFilter);
+        }
+    });
+
+    instance->writer = QThread::create([] { instance->run(); });
+    instance->writer->start(QThread::LowPriority);
+
     qDebug() << "Logging handler initialized";
     return instance;
 }
 
+void Logging::shutdown()
+{
+    if (!instance || !instance->writer)
+        return;
+
+    instance->stopping = true;
+    instance->wake.release();
+    instance->writer->wait();
+    delete instance->writer;
+    instance->writer = nullptr;
+}
+
 void Logging::categoryFilter(QLoggingCategory *category)
 {
     if (strcmp(category->categoryName(), "default") == 0)
@@ -50,11 +77,49 @@ void Logging::categoryFilter(QLoggingCategory *category)
 
 void Logging::messageOutput(QtMsgType type, const QMessageLogContext &context, const QString &msg)
 {
-    QByteArray localMsg = msg.toLocal8Bit();
-    const char *file = context.file ? context.file : "";
-    const char *function = context.function ? context.function : "";
-    QString qtype;
-    switch (type)
+    auto self = instance;
+    if (!self || (type == QtDebugMsg && !self->debug))
+        return;
+
+    //context strings are literals baked into the binary, so only the
+    //pointers are kept and formatting waits for the writer
+    LogRing::Record record;
+    record.type = type;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.message = msg;
+    record.file = context.file;
+    record.line = context.line;
+    record.function = context.function;
+
+    if (type == QtFatalMsg || !self->writer)
+    {
+        //the process is about to abort, so whatever is still in the ring
+        //goes out first, unless the writer itself is the one aborting
+        if (type == QtFatalMsg && self->writer && QThread::currentThread() != self->writer)
+        {
+            shutdown();
+        }
+        if (type == QtFatalMsg || self->debug)
+        {
+            self->write(stamp(record, format(record)));
+        }
+        return;
+    }
+
+    if (!self->ring.push(std::move(record)))
+    {
+        self->dropped++;
+    }
+    if (self->sleeping.exchange(false))
+    {
+        self->wake.release();
+    }
+}
+
+QString Logging::format(const LogRing::Record &record)
+{
+    const char *qtype = "";
+    switch (record.type)
     {
     case QtDebugMsg:
         qtype = "Debug";
@@ -72,24 +137,93 @@ void Logging::messageOutput(QtMsgType type, const QMessageLogContext &context, c
         qtype = "Fatal";
         break;
     }
-    emit instance->OnLogEvent(QString("%1: %2 (%3:%4, %5)")
-                                .arg(qtype)
-                                .arg(localMsg.constData())
-                                .arg(file)
-                                .arg(context.line)
-                                .arg(function)
-                              );
+
+    QString line;
+    line.reserve(record.message.size() + 64);
+    line += QLatin1String(qtype);
+    line += QLatin1String(": ");
+    line += record.message;
+    line += QLatin1String(" (");
+    line += QLatin1String(record.file ? record.file : "");
+    line += ':';
+    line += QString::number(record.line);
+    line += QLatin1String(", ");
+    line += QLatin1String(record.function ? record.function : "");
+    line += ')';
+    return line;
+}
+
+QByteArray Logging::stamp(const LogRing::Record &record, const QString &line)
+{
+    auto time = QDateTime::fromMSecsSinceEpoch(record.time).toString("[MMM dd, yyyy HH:mm:ss ap] ");
+    return (time + line + "\n").toLatin1();
 }
 
-void Logging::logEvent(QString msg)
+void Logging::run()
 {
-    if (Settings::value("debug").toBool())
+    LogRing::Record record;
+    QByteArray batch;
+    QString last;
+    forever
     {
-        QString log(QDateTime::currentDateTime().toString("[MMM dd, yyyy HH:mm:ss ap] ") + msg + "\n");
-        file->write(log.toLatin1());
-        if (!file->flush())
+        bool stop = stopping;
+        bool logToFile = debug;
+        batch.clear();
+        last.clear();
+
+        while (ring.pop(&record))
+        {
+            last = format(record);
+            if (logToFile)
+            {
+                batch += stamp(record, last);
+            }
+        }
+
+        int lost = dropped.exchange(0);
+        if (lost && logToFile)
+        {
+            batch += QString("[%1 log messages dropped]\n").arg(lost).toLatin1();
+        }
+
+        if (!batch.isEmpty())
         {
-            qWarning("Unable to write log to file");
+            write(batch);
         }
+        if (!last.isEmpty())
+        {
+            //the status bar only ever shows the newest line
+            emit OnLogEvent(last);
+        }
+
+        //stopping was read before the drain, so everything pushed up to
+        //then has been written
+        if (stop)
+            break;
+
+        if (last.isEmpty())
+        {
+            //a producer that missed the flag is caught by the second look,
+            //and at worst by the timeout
+            sleeping = true;
+            if (ring.isEmpty())
+            {
+                wake.tryAcquire(1, IdleWait);
+            }
+            sleeping = false;
+        }
+    }
+}
+
+void Logging::write(const QByteArray &batch)
+{
+    QMutexLocker locker(&fileMutex);
+    if (!file || !file->isOpen())
+        return;
+
+    file->write(batch);
+    if (!file->flush())
+    {
+        fprintf(stderr, "Unable to write log to file\n");
     }
 }
@@ -6,8 +6,19 @@
 #include <QLoggingCategory>
 #include <QCoreApplication>
 #include <QFile>
+#include <QMutex>
 #include <QDateTime>
+#include <QSemaphore>
+#include <QThread>
+#include <atomic>
 
+#include "logring.h"
+
+//Message handler that keeps logging off the threads doing the work. A
+//message that passes the level filter is pushed as a raw record into a
+//lock-free ring, and a writer thread formats whatever has piled up and
+//writes it to the log file in one go, then hands only the newest line to
+//the window.
 class Logging : public QObject
 {
     Q_OBJECT
@@ -17,20 +28,39 @@ public:
 
     static Logging *initialize();
 
+    //drains the ring and stops the writer, called once the event loop is done
+    static void shutdown();
+
     static void categoryFilter(QLoggingCategory *category);
 
     static void messageOutput(QtMsgType type, const QMessageLogContext &context, const QString &msg);
 
     static Logging *instance;
 
+    static const int Capacity = 8192;
+    static const int IdleWait = 1000;
+
 private:
-    QFile *file;
+    static QString format(const LogRing::Record &record);
+    static QByteArray stamp(const LogRing::Record &record, const QString &line);
+
+    void run();
+    void write(const QByteArray &batch);
+
+    //writes come from the writer, and from any thread once it is gone or
+    //when a fatal message cannot wait for it
+    QMutex fileMutex;
+    QFile *file = nullptr;
+    LogRing ring;
+    QThread *writer = nullptr;
+    QSemaphore wake;
+    std::atomic<bool> sleeping { false };
+    std::atomic<bool> stopping { false };
+    std::atomic<bool> debug { false };
+    std::atomic<int> dropped { 0 };
 
 signals:
     void OnLogEvent(QString msg);
-
-public slots:
-    void logEvent(QString msg);
 };
 
 #endif // LOGGING_H
@@ -0,0 +1,110 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <QtCore/qglobal.h>
+#include <QString>
+#include <atomic>
+#include <memory>
+
+//Bounded queue of log records with any number of producers and a single
+//consumer. Every cell carries a sequence number telling whose turn it is,
+//so a push is one compare and swap on the tail and a pop touches nothing
+//shared but the cell itself. Neither side ever takes a lock, and a full
+//ring makes push fail instead of waiting.
+class LogRing
+{
+public:
+    struct Record
+    {
+        QtMsgType type = QtDebugMsg;
+        qint64 time = 0;
+        QString message;
+        const char *file = nullptr;
+        int line = 0;
+        const char *function = nullptr;
+    };
+
+    //capacity is rounded up to a power of two
+    explicit LogRing(int capacity)
+    {
+        size_t size = 2;
+        while (size < static_cast<size_t>(capacity))
+        {
+            size *= 2;
+        }
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    //safe from any thread, false when the ring is full
+    bool push(Record&& record)
+    {
+        Cell *cell;
+        size_t pos = tail.load(std::memory_order_relaxed);
+        forever
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<qptrdiff>(sequence) - static_cast<qptrdiff>(pos);
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->record = std::move(record);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //only ever called from the consumer, false when the ring is empty
+    bool pop(Record *record)
+    {
+        auto& cell = cells[head & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<qptrdiff>(sequence) - static_cast<qptrdiff>(head + 1) < 0)
+            return false;
+
+        *record = std::move(cell.record);
+        cell.record.message = QString();
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    //only meaningful on the consumer, producers may push right after
+    bool isEmpty() const
+    {
+        size_t sequence = cells[head & mask].sequence.load(std::memory_order_acquire);
+        return static_cast<qptrdiff>(sequence) - static_cast<qptrdiff>(head + 1) < 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+
+    //producers and the consumer each get a cache line of their own
+    alignas(64) std::atomic<size_t> tail { 0 };
+    alignas(64) size_t head = 0;
+};
+
+#endif // LOGRING_H
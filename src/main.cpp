@@ -10,5 +10,7 @@ int main(int argc, char *argv[])
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
-    return a.exec();
+    int code = a.exec();
+    Logging::shutdown();
+    return code;
 }
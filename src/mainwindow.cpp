@@ -2,7 +2,10 @@
 #include "ui_mainwindow.h"
 #include "logging.h"
 #include "helper.h"
+#include "metrics.h"
+#include "progress.h"
 #include "settings.h"
+#include "trace.h"
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
 {
@@ -18,11 +21,13 @@ MainWindow::~MainWindow()
 void MainWindow::initialize()
 {
     setWindowTitle("MapleSeed++ v1.1.1");
-    Settings settings;
+    Settings::initialize();
 
     connect(Logging::instance, &Logging::OnLogEvent, this, &MainWindow::logEvent);
 
     ui->actionDebug->setChecked(Settings::value("debug").toBool());
+    ui->actionTrace->setChecked(Settings::value("trace/enabled").toBool());
+    Trace::setEnabled(ui->actionTrace->isChecked());
     ui->actionCemuIntegrate->setChecked(Settings::value("cemu/enabled").toBool());
     ui->actionCemuFullscreen->setChecked(Settings::value("cemu/fullscreen").toBool());
     ui->actionGamepad->setChecked(Settings::value("Gamepad/enabled").toBool());
@@ -32,11 +37,34 @@ void MainWindow::initialize()
         Settings::setValue("cemu/coversDir", QDir(Settings::getdirpath()).filePath("covers"));
     }
 
+    Metrics::initialize();
+    ProgressMonitor::initialize();
     setupConnections();
     Gamepad::initialize();
-    CemuDatabase::initialize();
-    CemuLibrary::initialize();
     DownloadQueue::initialize();
+    TmdFetcher::initialize();
+    DownloadQueue::instance->setRateLimit(Settings::value("download/ratelimit").toLongLong() * 1024);
+    DownloadQueue::instance->setMaxConnections(Settings::value("download/connections", 6).toInt());
+    DownloadQueue::instance->setBandwidthProfiles(BandwidthProfile::parse(Settings::value("download/profiles").toString()));
+    QDir().mkpath(Settings::getdirpath());
+
+    //the library and the download journal both look titles up in the
+    //database, so they wait for CemuDbLoadComplete
+    refreshTimer.setSingleShot(true);
+    connect(&refreshTimer, &QTimer::timeout, this, [this]
+    {
+        filterDatabase(ui->regionBox->currentText(), ui->searchInput->text());
+    });
+    CemuDatabase::initialize();
+}
+
+void MainWindow::restoreDownloads()
+{
+    QString journal(QDir(Settings::getdirpath()).filePath("downloads.journal"));
+    for (const auto& entry : DownloadQueue::instance->restore(journal))
+    {
+        downloadCemuId(entry.id, entry.version, &entry);
+    }
 }
 
 void MainWindow::setupConnections()
@@ -49,20 +77,89 @@ void MainWindow::setupConnections()
     connect(Gamepad::instance, &Gamepad::prevTab, this, &MainWindow::prevTab, Qt::ConnectionType::UniqueConnection);
     connect(Gamepad::instance, &Gamepad::nextTab, this, &MainWindow::nextTab, Qt::ConnectionType::UniqueConnection);
     connect(CemuDatabase::instance, &CemuDatabase::OnLoadComplete, this, &MainWindow::CemuDbLoadComplete);
-    connect(CemuDatabase::instance, &CemuDatabase::OnNewEntry, this, &MainWindow::NewDatabaseEntry);
+    connect(CemuDatabase::instance, &CemuDatabase::OnBatchLoaded, this, &MainWindow::CemuDbBatchLoaded);
+    connect(CemuDatabase::instance, &CemuDatabase::OnRefreshComplete, this, &MainWindow::CemuDbRefreshComplete);
     connect(CemuLibrary::instance, &CemuLibrary::OnNewEntry, this, &MainWindow::NewLibraryEntry);
+    connect(CemuLibrary::instance, &CemuLibrary::OnRemoveEntry, this, &MainWindow::RemoveLibraryEntry);
     connect(DownloadQueue::instance, &DownloadQueue::OnEnqueue, this, &MainWindow::downloadQueueAdd);
-    connect(DownloadQueue::instance, &DownloadQueue::DownloadProgress, this, &MainWindow::updateDownloadProgress);
+    connect(ProgressMonitor::instance, &ProgressMonitor::frame, this, &MainWindow::renderProgress);
+    connect(Metrics::instance, &Metrics::sampled, this, &MainWindow::updateStats);
+}
+
+void MainWindow::downloadCemuId(QString id, QString ver, const DownloadJournal::Entry *restore)
+{
+    //the tmd is fetched in the background so queueing many titles at
+    //once does not freeze the window on one round-trip per title
+    DownloadJournal::Entry entry;
+    if (restore)
+    {
+        entry = *restore;
+    }
+    bool restoring = restore != nullptr;
+
+    TmdFetcher::instance->request(id, ver, this, [=](const QByteArray& tmd)
+    {
+        queueCemuId(id, ver, tmd, restoring ? &entry : nullptr);
+    });
 }
 
-void MainWindow::downloadCemuId(QString id, QString ver)
+void MainWindow::downloadEverything(const QStringList& ids)
 {
-    auto qinfo = Helper::GetWiiuDownloadInfo(id, ver);
+    QSet<quint64> queued;
+    for (const auto& id : ids)
+    {
+        auto info = CemuDatabase::find(id);
+        if (!info)
+            continue;
+
+        for (auto title : CemuDatabase::family(info->titleId()).downloads())
+        {
+            if (!queued.contains(title->titleId()))
+            {
+                queued.insert(title->titleId());
+                downloadCemuId(title->id(), "");
+            }
+        }
+    }
+    qInfo() << "Queued" << queued.count() << "titles for" << ids.count() << "games";
+}
+
+void MainWindow::queueCemuId(QString id, QString ver, QByteArray tmd, const DownloadJournal::Entry *restore)
+{
+    auto qinfo = Helper::GetWiiuDownloadInfo(id, ver, tmd);
     if (!qinfo) {
         qCritical() << "WiiU title download failed, could not find title info.";
+        if (!restore)
+            return;
+
+        //only a title the database no longer knows is dropped, a failed
+        //tmd fetch keeps the journal entry and its resume offsets
+        if (!CemuDatabase::find(id))
+        {
+            DownloadQueue::instance->discard(id);
+        }
+        else if (tmd.isEmpty())
+        {
+            qWarning() << "could not fetch tmd for" << id << "retrying in" << RestoreRetryInterval / 1000 << "seconds";
+            auto entry = *restore;
+            QTimer::singleShot(RestoreRetryInterval, this, [=]
+            {
+                downloadCemuId(entry.id, entry.version, &entry);
+            });
+        }
         return;
     }
 
+    if (restore)
+    {
+        qinfo->priority = restore->priority;
+        qinfo->resume = restore->offsets;
+        for (auto offset : restore->offsets)
+        {
+            qinfo->bytesReceived += offset;
+        }
+    }
+
     auto key = qinfo->userData.toString();
     auto crypto = CemuCrypto::initialize(key, qinfo->directory);
 
@@ -76,7 +173,6 @@ void MainWindow::downloadCemuId(QString id, QString ver)
 
     connect(watcher, &QFutureWatcher<void>::finished, this, [=]
     {
-        disconnect(crypto, &CemuCrypto::Progress, qinfo, &QueueInfo::updateProgress);
         delete watcher;
         delete qinfo;
         delete crypto;
@@ -87,7 +183,8 @@ void MainWindow::downloadCemuId(QString id, QString ver)
 
     connect(qinfo, &QueueInfo::finished, [=]
     {
-        connect(crypto, &CemuCrypto::Progress, qinfo, &QueueInfo::updateProgress);
+        crypto->progress = ProgressMonitor::track("decrypt", qinfo->name, ProgressTracker::Bytes);
+        qinfo->progress = crypto->progress;
         watcher->setFuture(QtConcurrent::run(crypto, &CemuCrypto::Start));
     });
 }
@@ -119,6 +216,59 @@ bool MainWindow::processActive()
     return true;
 }
 
+void MainWindow::updateStats()
+{
+    //nothing to redraw while the tab is hidden
+    if (ui->tabWidget->currentWidget() != ui->tab_5)
+        return;
+
+    auto rows = Metrics::rows();
+    auto table = ui->statsTableWidget;
+    table->setRowCount(rows.count());
+    for (int i = 0; i < rows.count(); i++)
+    {
+        const auto& row = rows.at(i);
+        bool bytes = row.name.contains("bytes");
+        QString value(bytes ? Helper::fomartSize(static_cast<float>(row.value)) : QString::number(row.value));
+        QString rate;
+        QString latency;
+        if (row.kind != Metrics::GaugeKind)
+        {
+            rate = bytes ? Helper::fomartSize(static_cast<float>(row.rate)) : QString::number(row.rate, 'f', 1);
+        }
+        if (row.kind == Metrics::HistogramKind)
+        {
+            latency = QString("%1 / %2 / %3 / %4").arg(row.p50).arg(row.p90).arg(row.p99).arg(row.max);
+        }
+
+        QStringList cells { row.name, value, rate, latency };
+        for (int column = 0; column < cells.count(); column++)
+        {
+            auto item = table->item(i, column);
+            if (!item)
+            {
+                item = new QTableWidgetItem;
+                table->setItem(i, column, item);
+            }
+            item->setText(cells.at(column));
+            item->setToolTip(row.help);
+        }
+    }
+    table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+}
+
+void MainWindow::on_saveStatsButton_clicked()
+{
+    QString path(QFileDialog::getSaveFileName(this, "Save Stats", "mapleseed-metrics.prom", "Prometheus Text (*.prom);;JSON (*.json)"));
+    if (path.isEmpty())
+        return;
+
+    if (!Metrics::save(path))
+    {
+        QMessageBox::warning(this, "Save Stats", "Could not write " + path);
+    }
+}
+
 void MainWindow::logEvent(QString msg)
 {
     if (mutex.tryLock(1000))
@@ -141,25 +291,42 @@ void MainWindow::downloadQueueAdd(QueueInfo *info)
     ui->downloadQueueTableWidget->setCellWidget(row, 2, &info->pgbar);
     ui->downloadQueueTableWidget->horizontalHeader()->setStretchLastSection(true);
     ui->downloadQueueTableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    connect(ProgressMonitor::instance, &ProgressMonitor::frame, info, &QueueInfo::render);
 }
 
-void MainWindow::updateDownloadProgress(qint64 bytesReceived, qint64 bytesTotal, QTime qtime)
+void MainWindow::renderProgress()
 {
-    float percent = Helper::CalculatePrecent(bytesReceived, bytesTotal);
-    auto speed = Helper::CalculateSpeed(bytesReceived, qtime);
+    auto progress = ProgressMonitor::instance->current();
+    if (!progress)
+        return;
 
-    ui->progressBar->setRange(0, 100);
-    ui->progressBar->setValue(static_cast<int>(percent));
-    ui->progressBar->setFormat("%p% " + Helper::fomartSize(bytesReceived) + " / " + Helper::fomartSize(bytesTotal) + " | " + speed);
-}
+    QString format("%p% " + progress->label + " | ");
+    if (progress->unit == ProgressTracker::Bytes)
+    {
+        format += Helper::fomartSize(progress->done()) + " / " + Helper::fomartSize(progress->total()) +
+                  " | " + Helper::fomartSize(static_cast<float>(progress->rate())) + "/s";
+    }
+    else
+    {
+        format += QString("%1 / %2 files").arg(progress->done()).arg(progress->total());
+    }
 
-void MainWindow::updateCemuCryptoProgress(int curfile, int maxfiles)
-{
-    float per = (static_cast<float>(curfile) / static_cast<float>(maxfiles)) * 100;
-    this->ui->progressBar->setRange(0, 100);
-    this->ui->progressBar->setValue(static_cast<int>(per));
-    this->ui->progressBar->setFormat(QString::number(static_cast<double>(per), 'G', 3) + "% | " +
-        QString::number(curfile) + " / " + QString::number(maxfiles) + " files");
+    if (!progress->isFinished())
+    {
+        auto eta = progress->eta();
+        if (eta >= 0 && eta < 24 * 60 * 60)
+        {
+            format += " | " + QTime(0, 0).addSecs(static_cast<int>(eta)).toString("h:mm:ss") + " left";
+        }
+        if (strcmp(progress->category, "download") == 0)
+        {
+            format += " | " + QString::number(DownloadQueue::instance->connections()) + " conn";
+        }
+    }
+
+    ui->progressBar->setRange(0, 100);
+    ui->progressBar->setValue(progress->percent());
+    ui->progressBar->setFormat(format);
 }
 
 void MainWindow::on_showContextMenu(QListWidget *listWidget, const QPoint &pos)
@@ -185,25 +352,36 @@ void MainWindow::on_showContextMenu(QListWidget *listWidget, const QPoint &pos)
     menu.addAction(name, [=]{})->setEnabled(false);
 
     menu.addSeparator();
-    if (CemuDatabase::ValidId(info->id().replace(7, 1, '0'))) {
-        menu.addAction("Download Game", this, [&]
+    auto family = CemuDatabase::family(info->titleId());
+    if (family.game) {
+        menu.addAction("Download Game", this, [=]
         {
-            downloadCemuId(info->id().replace(7, 1, '0'), "");
+            downloadCemuId(family.game->id(), "");
         });
     }
-    if (CemuDatabase::ValidId(info->id().replace(7, 1, 'c'))) {
-        menu.addAction("Download DLC", this, [&]
+    if (family.dlc) {
+        menu.addAction("Download DLC", this, [=]
         {
-            downloadCemuId(info->id().replace(7, 1, 'c'), "");
+            downloadCemuId(family.dlc->id(), "");
         });
     }
-    if (CemuDatabase::ValidId(info->id().replace(7, 1, 'e'))) {
-        menu.addAction("Download Patch", this, [&]
+    if (family.update) {
+        menu.addAction("Download Patch", this, [=]
         {
-            downloadCemuId(info->id().replace(7, 1, 'e'), "");
+            downloadCemuId(family.update->id(), "");
         });
     }
 
+    QStringList selected;
+    for (auto selectedItem : listWidget->selectedItems())
+    {
+        selected.append(selectedItem->data(Qt::UserRole).toString());
+    }
+    menu.addAction(selected.count() > 1 ? QString("Download Everything (%1 titles)").arg(selected.count()) : QString("Download Everything"), this, [=]
+    {
+        downloadEverything(selected);
+    });
+
     if (QFileInfo(info->Rpx()).exists() && Settings::value("cemu/enabled").toBool())
     {
         QtCompressor compressor;
@@ -258,7 +436,6 @@ void MainWindow::on_showContextMenu(QListWidget *listWidget, const QPoint &pos)
             QtConcurrent::run([=]
             {
                 CemuCrypto crypto(info->key(), info->dir());
-                connect(&crypto, &CemuCrypto::Progress, this, &MainWindow::updateCemuCryptoProgress);
                 crypto.Start();
             });
         });
@@ -271,35 +448,115 @@ void MainWindow::on_showContextMenu(QListWidget *listWidget, const QPoint &pos)
 
 void MainWindow::CemuDbLoadComplete()
 {
-    Helper::filter("USA", "", ui->databaseListWidget);
+    refreshTimer.stop();
+    filterDatabase("USA", "");
+
+    if (!databaseLoaded)
+    {
+        databaseLoaded = true;
+        CemuLibrary::initialize();
+        restoreDownloads();
+    }
 }
 
-void MainWindow::NewDatabaseEntry(TitleInfo *info)
+void MainWindow::CemuDbBatchLoaded(int)
 {
-    if (info->titleType() != TitleType::Game) return;
+    //rebuilding the list for every batch would cost more than the parse
+    if (!refreshTimer.isActive())
+    {
+        refreshTimer.start(RefreshInterval);
+    }
+}
 
-    auto item = new QListWidgetItem();
-    item->setData(Qt::DisplayRole, info->formatName());
-    item->setData(Qt::UserRole, info->id());
-    ui->databaseListWidget->addItem(item);
+void MainWindow::CemuDbRefreshComplete(int added, int changed, int removed)
+{
+    if (added || changed || removed)
+    {
+        filterDatabase(ui->regionBox->currentText(), ui->searchInput->text());
+    }
 }
 
-void MainWindow::NewLibraryEntry(QString xmlfile)
+void MainWindow::filterDatabase(const QString& region, const QString& text)
 {
-    TitleInfo* info;
-    if (!(info = CemuDatabase::Create(xmlfile))) {
-        qDebug() << "NewLibraryEntry: XML File could not be parsed." << xmlfile;
-        return;
+    //one version answers every lookup, so the list matches itself even
+    //while a refresh is being published
+    auto store = CemuDatabase::current();
+    QList<const TitleInfo*> titles;
+    if (text.trimmed().isEmpty())
+    {
+        for (auto info : store->findTitleHigh(0x00050000))
+        {
+            if (region.isEmpty() || info->region() == region)
+            {
+                titles.append(info);
+            }
+        }
+        std::sort(titles.begin(), titles.end(), [](const TitleInfo *a, const TitleInfo *b) { return a->formatName() < b->formatName(); });
+    }
+    else
+    {
+        qInfo() << "filter:" << text;
+        for (auto id : store->search(text))
+        {
+            auto info = store->find(id);
+            if (info && info->titleType() == TitleType::Game && (region.isEmpty() || info->region() == region))
+            {
+                titles.append(info);
+                if (titles.count() == MaxSearchResults)
+                    break;
+            }
+        }
     }
 
-    if (info->titleType() == TitleType::Game)
+    //the list is rebuilt from the results in their order, which is
+    //cheaper than hiding and showing every item it held before
+    auto list = ui->databaseListWidget;
+    list->setUpdatesEnabled(false);
+    list->setSortingEnabled(false);
+    list->clear();
+    for (auto info : titles)
     {
         auto item = new QListWidgetItem();
         item->setData(Qt::DisplayRole, info->formatName());
         item->setData(Qt::UserRole, info->id());
-        ui->libraryListWidget->addItem(item);
-        CemuLibrary::instance->library[info->id()] = info;
+        list->addItem(item);
     }
+    list->setUpdatesEnabled(true);
+}
+
+void MainWindow::NewLibraryEntry(QString xmlfile, QString titleId)
+{
+    auto info = CemuDatabase::Create(xmlfile, titleId);
+    if (info.id().isEmpty()) {
+        qDebug() << "NewLibraryEntry: XML File could not be parsed." << xmlfile;
+        return;
+    }
+
+    if (info.titleType() == TitleType::Game)
+    {
+        //a title that changed on disk is reported again and keeps its item
+        if (!CemuLibrary::find(info.id()))
+        {
+            auto item = new QListWidgetItem();
+            item->setData(Qt::DisplayRole, info.formatName());
+            item->setData(Qt::UserRole, info.id());
+            ui->libraryListWidget->addItem(item);
+        }
+        CemuLibrary::instance->insert(info);
+    }
+}
+
+void MainWindow::RemoveLibraryEntry(QString titleId)
+{
+    auto list = ui->libraryListWidget;
+    for (int i = list->count() - 1; i >= 0; i--)
+    {
+        if (list->item(i)->data(Qt::UserRole).toString() == titleId)
+        {
+            delete list->takeItem(i);
+        }
+    }
+    CemuLibrary::instance->remove(titleId);
 }
 
 void MainWindow::on_actionExit_triggered()
@@ -330,6 +587,24 @@ void MainWindow::on_actionOpenLog_triggered()
     }
 }
 
+void MainWindow::on_actionTrace_triggered(bool checked)
+{
+    Settings::setValue("trace/enabled", checked);
+    Trace::setEnabled(checked);
+}
+
+void MainWindow::on_actionSaveTrace_triggered()
+{
+    QString path(QFileDialog::getSaveFileName(this, "Save Trace", "mapleseed-trace.json", "Chrome Trace (*.json)"));
+    if (path.isEmpty())
+        return;
+
+    if (!Trace::save(path))
+    {
+        QMessageBox::warning(this, "Save Trace", "Could not write " + path);
+    }
+}
+
 void MainWindow::on_actionCemuFullscreen_triggered(bool checked)
 {
     Settings::setValue("cemu/fullscreen", checked);
@@ -382,14 +657,19 @@ void MainWindow::on_actionCemuRefreshLibrary_triggered()
     QtConcurrent::run([=] { CemuLibrary::instance->init(directory); });
 }
 
+void MainWindow::on_actionCemuRefreshDatabase_triggered()
+{
+    CemuDatabase::instance->refresh();
+}
+
 void MainWindow::on_searchInput_textEdited(const QString &arg1)
 {
-    Helper::filter(ui->regionBox->currentText(), arg1, ui->databaseListWidget);
+    filterDatabase(ui->regionBox->currentText(), arg1);
 }
 
 void MainWindow::on_regionBox_currentTextChanged(const QString &arg1)
 {
-    Helper::filter(arg1, ui->searchInput->text(), ui->databaseListWidget);
+    filterDatabase(arg1, ui->searchInput->text());
 }
 
 void MainWindow::on_libraryListWidget_itemSelectionChanged()
@@ -412,6 +692,74 @@ void MainWindow::on_databaseListWidget_customContextMenuRequested(const QPoint &
     on_showContextMenu(ui->databaseListWidget, pos);
 }
 
+void MainWindow::on_downloadQueueTableWidget_customContextMenuRequested(const QPoint &pos)
+{
+    auto table = ui->downloadQueueTableWidget;
+    int row = table->rowAt(pos.y());
+    if (row < 0)
+        return;
+
+    //rows move as titles finish, the progress bar is what ties a row to
+    //its title
+    QPointer<QueueInfo> info;
+    for (auto item : DownloadQueue::instance->items())
+    {
+        if (table->cellWidget(row, 2) == &item->pgbar)
+        {
+            info = item;
+            break;
+        }
+    }
+    if (!info)
+        return;
+
+    QMenu menu;
+    menu.addAction(info->name, [=]{})->setEnabled(false);
+    menu.addSeparator();
+
+    if (info->failed)
+    {
+        menu.addAction("Retry", this, [=]
+        {
+            if (info)
+            {
+                DownloadQueue::instance->retry(info);
+            }
+        });
+    }
+
+    auto priority = menu.addMenu("Priority");
+    const QList<QPair<QString, int>> levels { {"High", QueueInfo::High}, {"Normal", QueueInfo::Normal}, {"Low", QueueInfo::Low} };
+    for (const auto& level : levels)
+    {
+        auto action = priority->addAction(level.first, this, [=]
+        {
+            if (info)
+            {
+                DownloadQueue::instance->setPriority(info, level.second);
+            }
+        });
+        action->setCheckable(true);
+        action->setChecked(info->priority == level.second);
+    }
+
+    menu.addAction("Limit Speed...", this, [=]
+    {
+        if (!info)
+            return;
+
+        bool ok;
+        int rate = QInputDialog::getInt(this, info->name, "Speed limit in KiB/s, 0 for unlimited",
+                                        static_cast<int>(info->limiter.rate() / 1024), 0, 1024 * 1024, 64, &ok);
+        if (ok && info)
+        {
+            DownloadQueue::instance->setRateLimit(info, static_cast<qint64>(rate) * 1024);
+        }
+    });
+
+    menu.exec(table->viewport()->mapToGlobal(pos));
+}
+
 void MainWindow::on_actionCemuDecrypt_triggered()
 {
     QDir* dir = Helper::SelectDirectory();
@@ -434,7 +782,6 @@ void MainWindow::on_actionCemuDecrypt_triggered()
     QtConcurrent::run([=]
     {
         CemuCrypto crypto("", path);
-        connect(&crypto, &CemuCrypto::Progress, this, &MainWindow::updateCemuCryptoProgress);
         crypto.Start();
     });
 }
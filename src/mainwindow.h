@@ -6,11 +6,14 @@
 #include <QtConcurrent>
 #include <QDesktopServices>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QListWidget>
 #include "gamepad.h"
 #include "cemu/database.h"
 #include "cemu/library.h"
+#include "cemu/tmdfetcher.h"
 #include "network/queueinfo.h"
+#include "network/downloadjournal.h"
 
 namespace Ui {
 class MainWindow;
@@ -28,28 +31,50 @@ public:
 
     void setupConnections();
 
-    void downloadCemuId(QString id, QString ver);
+    void restoreDownloads();
+
+    void downloadCemuId(QString id, QString ver, const DownloadJournal::Entry *restore = nullptr);
+
+    //queues the game, update and dlc of every title in ids
+    void downloadEverything(const QStringList& ids);
+
+    void queueCemuId(QString id, QString ver, QByteArray tmd, const DownloadJournal::Entry *restore = nullptr);
 
     void executeCemu(QString rpxPath);
 
     bool processActive();
 
+    //fills the database list with the games matching a region and search
+    void filterDatabase(const QString& region, const QString& text);
+
+    static const int MaxSearchResults = 500;
+
+    static const int RefreshInterval = 250;
+
+    static const int RestoreRetryInterval = 60000;
+
 private slots:
       void logEvent(QString msg);
 
       void downloadQueueAdd(QueueInfo *info);
 
-      void updateDownloadProgress(qint64 bytesReceived, qint64 bytesTotal, QTime qtime);
-
-      void updateCemuCryptoProgress(int curfile, int maxfiles);
+      void renderProgress();
 
       void on_showContextMenu(QListWidget* listWidget, const QPoint& pos);
 
       void CemuDbLoadComplete();
 
-      void NewDatabaseEntry(TitleInfo*info);
+      void CemuDbBatchLoaded(int count);
 
-      void NewLibraryEntry(QString xmlfile);
+      void CemuDbRefreshComplete(int added, int changed, int removed);
+
+      void NewLibraryEntry(QString xmlfile, QString titleId);
+
+      void RemoveLibraryEntry(QString titleId);
+
+      void updateStats();
+
+      void on_saveStatsButton_clicked();
 
       void on_actionExit_triggered();
 
@@ -59,6 +84,10 @@ private slots:
 
       void on_actionOpenLog_triggered();
 
+      void on_actionTrace_triggered(bool checked);
+
+      void on_actionSaveTrace_triggered();
+
       void on_actionCemuFullscreen_triggered(bool checked);
 
       void on_actionCemuIntegrate_triggered(bool checked);
@@ -67,6 +96,8 @@ private slots:
 
       void on_actionCemuRefreshLibrary_triggered();
 
+      void on_actionCemuRefreshDatabase_triggered();
+
       void on_searchInput_textEdited(const QString &arg1);
 
       void on_regionBox_currentTextChanged(const QString &arg1);
@@ -79,6 +110,8 @@ private slots:
 
       void on_databaseListWidget_customContextMenuRequested(const QPoint &pos);
 
+      void on_downloadQueueTableWidget_customContextMenuRequested(const QPoint &pos);
+
       void on_actionCemuDecrypt_triggered();
 
       void on_libraryListWidget_itemDoubleClicked(QListWidgetItem *item);
@@ -99,6 +132,8 @@ private slots:
 
 private:
     Ui::MainWindow *ui;
+    QTimer refreshTimer;
+    bool databaseLoaded = false;
     QMutex mutex;
     QProcess* process = new QProcess;
 };
@@ -0,0 +1,306 @@
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QtDebug>
+#include <deque>
+#include "metrics.h"
+
+Metrics *Metrics::instance;
+
+void Histogram::record(qint64 value)
+{
+    if (value < 0)
+    {
+        value = 0;
+    }
+    counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    summed.fetch_add(value, std::memory_order_relaxed);
+
+    qint64 seen = largest.load(std::memory_order_relaxed);
+    while (value > seen && !largest.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+int Histogram::bucket(qint64 value)
+{
+    if (value < SubBuckets)
+        return static_cast<int>(value);
+
+    int exponent = 63;
+    while (!(static_cast<quint64>(value) >> exponent))
+    {
+        exponent--;
+    }
+    if (exponent > MaxExponent)
+        return Buckets - 1;
+
+    int sub = static_cast<int>(value >> (exponent - SubBits)) & (SubBuckets - 1);
+    return (exponent - SubBits + 1) * SubBuckets + sub;
+}
+
+qint64 Histogram::upperBound(int bucket)
+{
+    if (bucket < SubBuckets)
+        return bucket;
+
+    int exponent = bucket / SubBuckets + SubBits - 1;
+    int sub = bucket % SubBuckets;
+    return ((static_cast<qint64>(SubBuckets + sub + 1)) << (exponent - SubBits)) - 1;
+}
+
+qint64 Histogram::percentile(double fraction) const
+{
+    qint64 samples = count();
+    if (samples == 0)
+        return 0;
+
+    auto wanted = static_cast<qint64>(fraction * samples + 0.5);
+    if (wanted < 1)
+    {
+        wanted = 1;
+    }
+
+    qint64 seen = 0;
+    for (int i = 0; i < Buckets; i++)
+    {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= wanted)
+            return qMin(upperBound(i), max());
+    }
+    return max();
+}
+
+namespace
+{
+    struct Entry
+    {
+        QString name;
+        QString help;
+        Metrics::Kind kind;
+        void *metric;
+        qint64 last;
+        double rate;
+    };
+
+    //entries are only appended, so pointers handed out stay valid
+    struct Registry
+    {
+        QMutex mutex;
+        std::deque<Entry> entries;
+    };
+
+    Registry& registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    void *add(const char *name, const char *help, Metrics::Kind kind, void *(*create)())
+    {
+        auto& reg = registry();
+        QMutexLocker locker(&reg.mutex);
+        for (const auto& entry : reg.entries)
+        {
+            if (entry.name == QLatin1String(name))
+            {
+                Q_ASSERT(entry.kind == kind);
+                return entry.metric;
+            }
+        }
+
+        reg.entries.push_back({ QString(name), QString(help), kind, create(), 0, 0.0 });
+        return reg.entries.back().metric;
+    }
+}
+
+Metrics::Metrics(QObject *parent) : QObject(parent)
+{
+    connect(&sampleTimer, &QTimer::timeout, this, &Metrics::sample);
+}
+
+Metrics *Metrics::initialize()
+{
+    if (!instance)
+    {
+        instance = new Metrics;
+        instance->sampleClock.start();
+        instance->sampleTimer.start(SampleInterval);
+    }
+    return instance;
+}
+
+Counter *Metrics::counter(const char *name, const char *help)
+{
+    return static_cast<Counter*>(add(name, help, CounterKind, []() -> void* { return new Counter; }));
+}
+
+Gauge *Metrics::gauge(const char *name, const char *help)
+{
+    return static_cast<Gauge*>(add(name, help, GaugeKind, []() -> void* { return new Gauge; }));
+}
+
+Histogram *Metrics::histogram(const char *name, const char *help)
+{
+    return static_cast<Histogram*>(add(name, help, HistogramKind, []() -> void* { return new Histogram; }));
+}
+
+void Metrics::sample()
+{
+    double seconds = sampleClock.restart() / 1000.0;
+    if (seconds <= 0)
+        return;
+
+    auto& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    for (auto& entry : reg.entries)
+    {
+        qint64 value;
+        if (entry.kind == CounterKind)
+        {
+            value = static_cast<Counter*>(entry.metric)->value();
+        }
+        else if (entry.kind == HistogramKind)
+        {
+            value = static_cast<Histogram*>(entry.metric)->count();
+        }
+        else
+        {
+            continue;
+        }
+        entry.rate = (value - entry.last) / seconds;
+        entry.last = value;
+    }
+    locker.unlock();
+
+    emit sampled();
+}
+
+QVector<Metrics::Row> Metrics::rows()
+{
+    QVector<Row> rows;
+    auto& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    rows.reserve(static_cast<int>(reg.entries.size()));
+    for (const auto& entry : reg.entries)
+    {
+        Row row { entry.name, entry.help, entry.kind, 0, entry.rate, 0, 0, 0, 0 };
+        switch (entry.kind)
+        {
+        case CounterKind:
+            row.value = static_cast<Counter*>(entry.metric)->value();
+            break;
+        case GaugeKind:
+            row.value = static_cast<Gauge*>(entry.metric)->value();
+            break;
+        case HistogramKind:
+        {
+            auto histogram = static_cast<Histogram*>(entry.metric);
+            row.value = histogram->count();
+            row.p50 = histogram->percentile(0.5);
+            row.p90 = histogram->percentile(0.9);
+            row.p99 = histogram->percentile(0.99);
+            row.max = histogram->max();
+            break;
+        }
+        }
+        rows.append(row);
+    }
+    return rows;
+}
+
+QByteArray Metrics::toJson()
+{
+    QJsonArray array;
+    for (const auto& row : rows())
+    {
+        QJsonObject object;
+        object["name"] = row.name;
+        object["help"] = row.help;
+        switch (row.kind)
+        {
+        case CounterKind:
+            object["type"] = "counter";
+            object["value"] = row.value;
+            object["rate"] = row.rate;
+            break;
+        case GaugeKind:
+            object["type"] = "gauge";
+            object["value"] = row.value;
+            break;
+        case HistogramKind:
+            object["type"] = "histogram";
+            object["count"] = row.value;
+            object["rate"] = row.rate;
+            object["p50"] = row.p50;
+            object["p90"] = row.p90;
+            object["p99"] = row.p99;
+            object["max"] = row.max;
+            break;
+        }
+        array.append(object);
+    }
+    return QJsonDocument(array).toJson();
+}
+
+QByteArray Metrics::toPrometheus()
+{
+    QByteArray text;
+    auto& reg = registry();
+    QMutexLocker locker(&reg.mutex);
+    for (const auto& entry : reg.entries)
+    {
+        auto name = "mapleseed_" + entry.name.toLatin1();
+        text += "# HELP " + name + " " + entry.help.toUtf8() + "\n";
+        switch (entry.kind)
+        {
+        case CounterKind:
+            text += "# TYPE " + name + " counter\n";
+            text += name + " " + QByteArray::number(static_cast<Counter*>(entry.metric)->value()) + "\n";
+            break;
+        case GaugeKind:
+            text += "# TYPE " + name + " gauge\n";
+            text += name + " " + QByteArray::number(static_cast<Gauge*>(entry.metric)->value()) + "\n";
+            break;
+        case HistogramKind:
+        {
+            //the buckets are too fine to list, so they go out as a summary
+            auto histogram = static_cast<Histogram*>(entry.metric);
+            text += "# TYPE " + name + " summary\n";
+            for (auto quantile : { "0.5", "0.9", "0.99" })
+            {
+                text += name + "{quantile=\"" + quantile + "\"} " +
+                        QByteArray::number(histogram->percentile(QByteArray(quantile).toDouble())) + "\n";
+            }
+            text += name + "_sum " + QByteArray::number(histogram->sum()) + "\n";
+            text += name + "_count " + QByteArray::number(histogram->count()) + "\n";
+            break;
+        }
+        }
+    }
+    return text;
+}
+
+bool Metrics::save(const QString& path)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "could not write metrics" << file.errorString();
+        return false;
+    }
+
+    bool json = QFileInfo(path).suffix().compare("json", Qt::CaseInsensitive) == 0;
+    file.write(json ? toJson() : toPrometheus());
+    if (!file.commit())
+    {
+        qWarning() << "could not write metrics" << file.errorString();
+        return false;
+    }
+    qInfo() << "saved metrics to" << path;
+    return true;
+}
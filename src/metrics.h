@@ -0,0 +1,130 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include <atomic>
+
+//A running total, such as bytes written or hashes checked.
+class Counter
+{
+public:
+    void add(qint64 n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+
+    qint64 value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> count { 0 };
+};
+
+//A level that goes up and down, such as the length of the download queue.
+class Gauge
+{
+public:
+    void set(qint64 n) { level.store(n, std::memory_order_relaxed); }
+
+    void add(qint64 n) { level.fetch_add(n, std::memory_order_relaxed); }
+
+    qint64 value() const { return level.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<qint64> level { 0 };
+};
+
+//Latency distribution in the style of an HDR histogram. Every power of two
+//is split into SubBuckets linear buckets, so a percentile is within about
+//six percent of the true value whatever its magnitude, and recording is a
+//couple of bit operations and three relaxed atomics.
+class Histogram
+{
+public:
+    static const int SubBits = 4;
+    static const int SubBuckets = 1 << SubBits;
+    static const int MaxExponent = 47;
+    static const int Buckets = (MaxExponent - SubBits + 2) * SubBuckets;
+
+    void record(qint64 value);
+
+    qint64 count() const { return total.load(std::memory_order_relaxed); }
+
+    qint64 sum() const { return summed.load(std::memory_order_relaxed); }
+
+    qint64 max() const { return largest.load(std::memory_order_relaxed); }
+
+    //the upper edge of the bucket holding the given fraction of samples
+    qint64 percentile(double fraction) const;
+
+    static int bucket(qint64 value);
+    static qint64 upperBound(int bucket);
+
+private:
+    std::atomic<qint64> counts[Buckets] {};
+    std::atomic<qint64> total { 0 };
+    std::atomic<qint64> summed { 0 };
+    std::atomic<qint64> largest { 0 };
+};
+
+//Registry of named counters, gauges and histograms. Metrics are created
+//once, usually into a static at the top of the file that updates them, and
+//never freed, so the hot path keeps a plain pointer and never looks a name
+//up. Once initialized, the registry samples every second to turn counters
+//into per second rates, and can be dumped as json or Prometheus text.
+class Metrics : public QObject
+{
+    Q_OBJECT
+public:
+    enum Kind
+    {
+        CounterKind,
+        GaugeKind,
+        HistogramKind
+    };
+
+    struct Row
+    {
+        QString name;
+        QString help;
+        Kind kind;
+        qint64 value;
+        double rate;
+        qint64 p50;
+        qint64 p90;
+        qint64 p99;
+        qint64 max;
+    };
+
+    explicit Metrics(QObject *parent = nullptr);
+
+    static Metrics *initialize();
+
+    static Metrics *instance;
+
+    //names are snake case without a prefix, help is a short sentence
+    static Counter *counter(const char *name, const char *help);
+    static Gauge *gauge(const char *name, const char *help);
+    static Histogram *histogram(const char *name, const char *help);
+
+    static QVector<Row> rows();
+
+    static QByteArray toJson();
+    static QByteArray toPrometheus();
+
+    //writes json for a .json path and Prometheus text for anything else
+    static bool save(const QString& path);
+
+    static const int SampleInterval = 1000;
+
+signals:
+    void sampled();
+
+private:
+    void sample();
+
+    QTimer sampleTimer;
+    QElapsedTimer sampleClock;
+};
+
+#endif // METRICS_H
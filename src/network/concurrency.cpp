@@ -0,0 +1,61 @@
+#include "concurrency.h"
+
+void ConcurrencyController::setMaximum(int maximum)
+{
+    max = qMax(static_cast<int>(Minimum), maximum);
+    current = qMin(current, max);
+}
+
+void ConcurrencyController::reset()
+{
+    current = qMin(static_cast<int>(Initial), max);
+    bytes_ = 0;
+    errors = 0;
+    previousRate = 0;
+}
+
+bool ConcurrencyController::sample(qint64 elapsed, int inflight, QString *message)
+{
+    if (elapsed <= 0)
+        return false;
+
+    double rate = bytes_ * 1000.0 / elapsed;
+    double perConnection = inflight > 0 ? rate / inflight : 0;
+    int previousLimit = current;
+    QString reason;
+
+    if (errors > 0)
+    {
+        current = qMax(static_cast<int>(Minimum), current / 2);
+        reason = QString("%1 failed transfers").arg(errors);
+    }
+    else if (inflight < current)
+    {
+        //not enough work queued to tell anything about the link
+    }
+    else if (previousRate <= 0 || rate > previousRate * 1.05)
+    {
+        current = qMin(max, current + 1);
+        reason = "goodput increased";
+    }
+    else if (rate < previousRate * 0.75)
+    {
+        current = qMax(static_cast<int>(Minimum), current * 3 / 4);
+        reason = "goodput dropped";
+    }
+
+    bytes_ = 0;
+    errors = 0;
+    previousRate = rate;
+
+    if (current == previousLimit)
+        return false;
+
+    if (message)
+    {
+        *message = QString("Download connections %1 -> %2 (%3, %4 KiB/s total, %5 KiB/s per connection)")
+                .arg(previousLimit).arg(current).arg(reason)
+                .arg(rate / 1024, 0, 'f', 0).arg(perConnection / 1024, 0, 'f', 0);
+    }
+    return true;
+}
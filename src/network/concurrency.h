@@ -0,0 +1,45 @@
+#ifndef CONCURRENCY_H
+#define CONCURRENCY_H
+
+#include "network_global.h"
+
+//Finds the number of parallel transfers where aggregate goodput stops
+//improving. Every sampling window the controller adds one transfer while
+//that still raises throughput (additive increase) and cuts back when
+//transfers fail or throughput collapses (multiplicative decrease).
+class ConcurrencyController
+{
+public:
+    ConcurrencyController() = default;
+
+    int limit() const { return current; }
+
+    int maximum() const { return max; }
+
+    void setMaximum(int maximum);
+
+    void reset();
+
+    void addBytes(qint64 bytes) { bytes_ += bytes; }
+
+    void addError() { errors++; }
+
+    //evaluates the window that just ended, returns true when the limit
+    //changed and describes the decision in message
+    bool sample(qint64 elapsed, int inflight, QString *message);
+
+    //last measured goodput in bytes per second
+    double goodput() const { return previousRate; }
+
+    static const int Minimum = 1;
+    static const int Initial = 2;
+
+private:
+    int current = Initial;
+    int max = 6;
+    qint64 bytes_ = 0;
+    int errors = 0;
+    double previousRate = 0;
+};
+
+#endif // CONCURRENCY_H
@@ -0,0 +1,198 @@
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include "downloadjournal.h"
+
+bool DownloadJournal::open(const QString& path)
+{
+    if (file.isOpen())
+    {
+        file.close();
+    }
+
+    order.clear();
+    state.clear();
+    records = 0;
+
+    file.setFileName(path);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        while (!file.atEnd())
+        {
+            //a torn last line from a crash simply fails to parse
+            auto doc = QJsonDocument::fromJson(file.readLine());
+            if (doc.isObject())
+            {
+                apply(doc.object());
+                records++;
+            }
+        }
+        file.close();
+    }
+
+    compact();
+    return file.isOpen();
+}
+
+void DownloadJournal::add(const Entry& entry)
+{
+    QJsonObject record;
+    record["op"] = "add";
+    record["id"] = entry.id;
+    record["version"] = entry.version;
+    record["name"] = entry.name;
+    record["priority"] = entry.priority;
+    append(record);
+}
+
+void DownloadJournal::setPriority(const QString& id, int priority)
+{
+    QJsonObject record;
+    record["op"] = "priority";
+    record["id"] = id;
+    record["priority"] = priority;
+    append(record);
+}
+
+void DownloadJournal::progress(const QString& id, const QString& filepath, qint64 offset)
+{
+    if (!state.contains(id) || state[id].offsets.value(filepath) == offset)
+        return;
+
+    QJsonObject record;
+    record["op"] = "progress";
+    record["id"] = id;
+    record["file"] = filepath;
+    record["offset"] = offset;
+    append(record);
+}
+
+void DownloadJournal::completed(const QString& id, const QString& filepath)
+{
+    QJsonObject record;
+    record["op"] = "done";
+    record["id"] = id;
+    record["file"] = filepath;
+    append(record);
+}
+
+void DownloadJournal::remove(const QString& id)
+{
+    QJsonObject record;
+    record["op"] = "remove";
+    record["id"] = id;
+    append(record);
+}
+
+QList<DownloadJournal::Entry> DownloadJournal::entries() const
+{
+    QList<Entry> list;
+    for (const auto& id : order)
+    {
+        list.append(state.value(id));
+    }
+    return list;
+}
+
+void DownloadJournal::append(const QJsonObject& record)
+{
+    apply(record);
+    if (!file.isOpen())
+        return;
+
+    file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + "\n");
+    file.flush();
+
+    if (++records >= CompactThreshold)
+    {
+        compact();
+    }
+}
+
+void DownloadJournal::apply(const QJsonObject& record)
+{
+    auto op = record["op"].toString();
+    auto id = record["id"].toString();
+    if (id.isEmpty())
+        return;
+
+    if (op == "add")
+    {
+        if (!state.contains(id))
+        {
+            order.append(id);
+        }
+        auto& entry = state[id];
+        entry.id = id;
+        entry.version = record["version"].toString();
+        entry.name = record["name"].toString();
+        entry.priority = record["priority"].toInt();
+    }
+    else if (!state.contains(id))
+    {
+        return;
+    }
+    else if (op == "priority")
+    {
+        state[id].priority = record["priority"].toInt();
+    }
+    else if (op == "progress")
+    {
+        state[id].offsets[record["file"].toString()] = static_cast<qint64>(record["offset"].toDouble());
+    }
+    else if (op == "done")
+    {
+        state[id].offsets.remove(record["file"].toString());
+    }
+    else if (op == "remove")
+    {
+        state.remove(id);
+        order.removeAll(id);
+    }
+}
+
+//rewrites the journal as the minimal set of records for the live state
+void DownloadJournal::compact()
+{
+    auto path = file.fileName();
+    if (file.isOpen())
+    {
+        file.close();
+    }
+
+    QSaveFile save(path);
+    if (save.open(QIODevice::WriteOnly))
+    {
+        for (const auto& id : order)
+        {
+            const auto& entry = state[id];
+            QJsonObject record;
+            record["op"] = "add";
+            record["id"] = entry.id;
+            record["version"] = entry.version;
+            record["name"] = entry.name;
+            record["priority"] = entry.priority;
+            save.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + "\n");
+
+            for (auto it = entry.offsets.constBegin(); it != entry.offsets.constEnd(); ++it)
+            {
+                QJsonObject progress;
+                progress["op"] = "progress";
+                progress["id"] = entry.id;
+                progress["file"] = it.key();
+                progress["offset"] = it.value();
+                save.write(QJsonDocument(progress).toJson(QJsonDocument::Compact) + "\n");
+            }
+        }
+        if (!save.commit())
+        {
+            qWarning() << "could not compact download journal" << save.errorString();
+        }
+    }
+
+    records = 0;
+    if (!file.open(QIODevice::Append))
+    {
+        qWarning() << "could not open download journal" << file.errorString();
+    }
+}
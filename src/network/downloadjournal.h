@@ -0,0 +1,52 @@
+#ifndef DOWNLOADJOURNAL_H
+#define DOWNLOADJOURNAL_H
+
+#include "network_global.h"
+
+//Append-only log of queue operations and per-content progress. Every
+//record is one JSON line flushed as soon as it is written, so after a
+//crash the queue can be rebuilt and each content resumed at the last
+//offset known to be on disk. The log is rewritten from the live state
+//once enough records have piled up.
+class DownloadJournal
+{
+public:
+    struct Entry
+    {
+        QString id;
+        QString version;
+        QString name;
+        int priority = 0;
+        QMap<QString, qint64> offsets;
+    };
+
+    DownloadJournal() = default;
+
+    //replays an existing journal and opens it for appending
+    bool open(const QString& path);
+
+    bool isOpen() const { return file.isOpen(); }
+
+    void add(const Entry& entry);
+    void setPriority(const QString& id, int priority);
+    void progress(const QString& id, const QString& filepath, qint64 offset);
+    void completed(const QString& id, const QString& filepath);
+    void remove(const QString& id);
+
+    //queued items in their original order
+    QList<Entry> entries() const;
+
+    static const int CompactThreshold = 4096;
+
+private:
+    void append(const QJsonObject& record);
+    void apply(const QJsonObject& record);
+    void compact();
+
+    QFile file;
+    QStringList order;
+    QMap<QString, Entry> state;
+    int records = 0;
+};
+
+#endif // DOWNLOADJOURNAL_H
@@ -1,8 +1,20 @@
 #include "downloadqueue.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace
+{
+    Gauge *const queueDepth = Metrics::gauge("download_queue_depth", "Titles waiting in the download queue, including the active one.");
+    Gauge *const activeTransfers = Metrics::gauge("download_active_transfers", "Content files being downloaded right now.");
+}
 
 DownloadQueue *DownloadQueue::instance = new DownloadQueue;
 
-DownloadQueue::DownloadQueue() = default;
+DownloadQueue::DownloadQueue()
+{
+    connect(&profileTimer, &QTimer::timeout, this, &DownloadQueue::applyProfiles);
+    connect(&sampleTimer, &QTimer::timeout, this, &DownloadQueue::sample);
+}
 
 DownloadQueue *DownloadQueue::initialize()
 {
@@ -18,40 +30,293 @@ DownloadQueue *DownloadQueue::initialize()
 
 void DownloadQueue::StartQueue()
 {
-    if (queue.isEmpty())
+    if (active)
+        return;
+
+    if (!next())
     {
         emit QueueFinished(history);
         history.clear();
         return;
     }
 
+    if (!manager)
+    {
+        manager = new QNetworkAccessManager(this);
+    }
+
     downloadTime.start();
-    auto qinfo = queue.first();
+    traceStart = Trace::isEnabled() ? Trace::now() : -1;
+    active = next();
+    preempted = false;
+    failed = false;
+    retrying = 0;
+    run++;
+    attempts.clear();
+    active->progress = ProgressMonitor::track("download", active->name, ProgressTracker::Bytes);
+    active->progress->setTotal(active->totalSize);
+    active->progress->setDone(active->bytesReceived);
 
-    for (auto pair : qinfo->urls)
+    pending.clear();
+    for (const auto& content : active->contents)
     {
-        QString filepath(pair.first);
-        QUrl url(pair.second);
-        DownloadSingle(url, filepath, qinfo);
+        //already finished before the item was paused
+        if (QFileInfo(content.filepath).size() != content.size)
+        {
+            pending.append(content);
+        }
     }
 
-    history.append(qinfo);
-    emit qinfo->finished();
-    emit OnDequeue(queue.dequeue());
-    qInfo() << "Remove from Queue " << qinfo->name;
+    controller.reset();
+    sampleClock.start();
+    sampleTimer.start(SampleInterval);
+    schedule();
+}
+
+void DownloadQueue::schedule()
+{
+    if (!active)
+        return;
+
+    while (!preempted && !pending.isEmpty() && transfers.count() < controller.limit())
+    {
+        auto transfer = new DownloadTransfer(pending.takeFirst(), active, manager, &limiter, this);
+        connect(transfer, &DownloadTransfer::progress, this, &DownloadQueue::progress);
+        connect(transfer, &DownloadTransfer::finished, this, &DownloadQueue::transferFinished, Qt::QueuedConnection);
+        transfers.append(transfer);
+        activeTransfers->set(transfers.count());
+        transfer->start();
+    }
 
-    StartQueue();
+    //contents waiting out a retry keep the title active
+    if (transfers.isEmpty() && (preempted || (pending.isEmpty() && !retrying)))
+    {
+        finishActive();
+    }
+}
+
+void DownloadQueue::transferFinished(DownloadTransfer *transfer)
+{
+    transfers.removeOne(transfer);
+    activeTransfers->set(transfers.count());
+    if (transfer->wasInterrupted() && !preempted)
+    {
+        controller.addError();
+    }
+
+    if (transfer->isSuccessful())
+    {
+        journal.completed(transfer->info->id, transfer->content.filepath);
+    }
+    else if (transfer->info->resume.contains(transfer->content.filepath))
+    {
+        journal.progress(transfer->info->id, transfer->content.filepath, transfer->info->resume[transfer->content.filepath]);
+    }
+
+    //a paused content is picked up with its title, anything else that
+    //failed goes back into pending after a growing delay
+    if (!transfer->isSuccessful() && !preempted)
+    {
+        auto content = transfer->content;
+        int attempt = ++attempts[content.filepath];
+        if (attempt > MaxRetries)
+        {
+            qCritical() << "giving up on" << content.url << "after" << MaxRetries << "retries";
+            failed = true;
+        }
+        else
+        {
+            int delay = RetryDelay << (attempt - 1);
+            qWarning() << "retrying" << content.url << "in" << delay << "ms";
+            retrying++;
+            int current = run;
+            QTimer::singleShot(delay, this, [this, content, current]
+            {
+                //the title may have been paused or finished in the meantime
+                if (current != run)
+                    return;
+
+                retrying--;
+                if (!preempted)
+                {
+                    pending.append(content);
+                }
+                schedule();
+            });
+        }
+    }
+    transfer->deleteLater();
+    schedule();
+}
+
+void DownloadQueue::finishActive()
+{
+    auto qinfo = active;
+    active = nullptr;
+    run++;
+    sampleTimer.stop();
+    qinfo->progress->finish();
+    Trace::async("download", preempted ? "title (paused)" : "title", reinterpret_cast<quintptr>(qinfo), traceStart, qinfo->bytesReceived);
+
+    if (preempted)
+    {
+        qInfo() << "Paused" << qinfo->name;
+    }
+    else if (failed)
+    {
+        //the finished contents and the journal stay, so retry() or the
+        //next start only fetches what is missing
+        qinfo->failed = true;
+        qinfo->pgbar.setFormat("Failed");
+        qCritical() << "Download failed:" << qinfo->name;
+    }
+    else
+    {
+        history.append(qinfo);
+        emit qinfo->finished();
+        queue.removeOne(qinfo);
+        queueDepth->set(queue.count());
+        journal.remove(qinfo->id);
+        emit OnDequeue(qinfo);
+        qInfo() << "Remove from Queue " << qinfo->name;
+    }
+
+    QTimer::singleShot(0, Qt::CoarseTimer, this, &DownloadQueue::StartQueue);
 }
 
 void DownloadQueue::add(QueueInfo *info)
 {
-    if (queue.isEmpty()) {
+    if (!active) {
         QTimer::singleShot(0, Qt::CoarseTimer, this, &DownloadQueue::StartQueue);
     }
 
-    queue.enqueue(info);
+    insert(info);
+
+    DownloadJournal::Entry entry;
+    entry.id = info->id;
+    entry.version = info->version;
+    entry.name = info->name;
+    entry.priority = info->priority;
+    journal.add(entry);
+
     emit OnEnqueue(info);
     qInfo() << "Add to Queue '" << info->name;
+    preempt();
+}
+
+void DownloadQueue::setPriority(QueueInfo *info, int priority)
+{
+    info->priority = priority;
+    journal.setPriority(info->id, priority);
+    if (queue.removeOne(info))
+    {
+        insert(info);
+        preempt();
+    }
+}
+
+void DownloadQueue::insert(QueueInfo *info)
+{
+    //keep the queue ordered by priority, first in first out within a level
+    int index = 0;
+    while (index < queue.count() && queue.at(index)->priority >= info->priority)
+    {
+        index++;
+    }
+    queue.insert(index, info);
+    queueDepth->set(queue.count());
+}
+
+QueueInfo *DownloadQueue::next() const
+{
+    for (auto info : queue)
+    {
+        if (!info->failed)
+            return info;
+    }
+    return nullptr;
+}
+
+void DownloadQueue::retry(QueueInfo *info)
+{
+    if (!info->failed || !queue.contains(info))
+        return;
+
+    qInfo() << "Retrying" << info->name;
+    info->failed = false;
+    info->pgbar.setFormat("%p%");
+    if (!active)
+    {
+        QTimer::singleShot(0, Qt::CoarseTimer, this, &DownloadQueue::StartQueue);
+    }
+    preempt();
+}
+
+void DownloadQueue::preempt()
+{
+    if (!active || next() == active)
+        return;
+
+    qInfo() << "Preempting" << active->name << "for" << next()->name;
+    preempted = true;
+    for (auto transfer : QList<DownloadTransfer*>(transfers))
+    {
+        transfer->abort();
+    }
+
+    //nothing is left to report back when every content was waiting out
+    //a retry
+    if (transfers.isEmpty())
+    {
+        schedule();
+    }
+}
+
+void DownloadQueue::setRateLimit(qint64 bytesPerSecond)
+{
+    rateLimit = bytesPerSecond;
+    applyProfiles();
+}
+
+void DownloadQueue::setRateLimit(QueueInfo *info, qint64 bytesPerSecond)
+{
+    qInfo() << "Download rate limit for" << info->name << ":" << (bytesPerSecond ? QString::number(bytesPerSecond / 1024) + " KiB/s" : QString("unlimited"));
+    info->limiter.setRate(bytesPerSecond);
+}
+
+void DownloadQueue::setBandwidthProfiles(const QList<BandwidthProfile>& profiles)
+{
+    this->profiles = profiles;
+    applyProfiles();
+
+    if (profiles.isEmpty())
+    {
+        profileTimer.stop();
+    }
+    else if (!profileTimer.isActive())
+    {
+        profileTimer.start(60 * 1000);
+    }
+}
+
+void DownloadQueue::applyProfiles()
+{
+    qint64 rate = rateLimit;
+    auto now = QTime::currentTime();
+    for (const auto& profile : profiles)
+    {
+        if (profile.contains(now))
+        {
+            rate = profile.rate;
+            break;
+        }
+    }
+
+    if (rate != limiter.rate())
+    {
+        qInfo() << "Download rate limit:" << (rate ? QString::number(rate / 1024) + " KiB/s" : QString("unlimited"));
+        limiter.setRate(rate);
+    }
 }
 
 bool DownloadQueue::exists(QueueInfo *info)
@@ -67,45 +332,53 @@ bool DownloadQueue::exists(QueueInfo *info)
     return result;
 }
 
-bool DownloadQueue::DownloadSingle(QUrl url, QString filepath, QueueInfo *info)
+bool DownloadQueue::isHttpRedirect(QNetworkReply *reply)
 {
-    auto file = &info->file;
-
-    file->setFileName(filepath);
-    if (!file->open(QIODevice::WriteOnly)) {
-        qCritical() << file->errorString();
-        return false;
-    }
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return statusCode == 301 || statusCode == 302 || statusCode == 303 || statusCode == 305 || statusCode == 307 || statusCode == 308;
+}
 
-    QNetworkAccessManager manager;
-    QNetworkRequest request(url);
+void DownloadQueue::setMaxConnections(int connections)
+{
+    controller.setMaximum(connections);
+}
 
-    QEventLoop loop;
-    info->reply = manager.get(request);
-    connect(info->reply, &QNetworkReply::downloadProgress, this, &DownloadQueue::progress);
-    connect(info->reply, &QNetworkReply::readyRead, info, &QueueInfo::readyRead);
-    connect(info->reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    connect(info->reply, &QNetworkReply::finished, [&]
+void DownloadQueue::progress(qint64 bytes)
+{
+    controller.addBytes(bytes);
+    if (active)
     {
-        if (isHttpRedirect(info->reply))
-        {
-            auto qVariant = info->reply->attribute(QNetworkRequest::RedirectionTargetAttribute);
-            DownloadSingle(qVariant.toUrl(), filepath, info);
-        }
-    });
-    loop.exec();
+        emit DownloadProgress(active->bytesReceived, active->totalSize, downloadTime);
+    }
+}
 
-    file->close();
-    return true;
+QList<DownloadJournal::Entry> DownloadQueue::restore(const QString& journalPath)
+{
+    journal.open(journalPath);
+    auto entries = journal.entries();
+    if (!entries.isEmpty())
+    {
+        qInfo() << "Restoring" << entries.count() << "queued downloads";
+    }
+    return entries;
 }
 
-bool DownloadQueue::isHttpRedirect(QNetworkReply *reply)
+void DownloadQueue::discard(const QString& id)
 {
-    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    return statusCode == 301 || statusCode == 302 || statusCode == 303 || statusCode == 305 || statusCode == 307 || statusCode == 308;
+    journal.remove(id);
 }
 
-void DownloadQueue::progress(qint64 received, qint64 total)
+void DownloadQueue::sample()
 {
-    emit DownloadProgress(received, total, downloadTime);
+    for (auto transfer : transfers)
+    {
+        journal.progress(transfer->info->id, transfer->content.filepath, transfer->bytesOnDisk());
+    }
+
+    QString message;
+    if (controller.sample(sampleClock.restart(), transfers.count(), &message))
+    {
+        qInfo() << message;
+        schedule();
+    }
 }
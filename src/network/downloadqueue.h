@@ -2,7 +2,12 @@
 #define NETWORK_H
 
 #include "queueinfo.h"
+#include "downloadtransfer.h"
+#include "concurrency.h"
+#include "downloadjournal.h"
 #include "network_global.h"
+#include <QElapsedTimer>
+
 class DownloadQueue : public QObject
 {
     Q_OBJECT
@@ -15,27 +20,89 @@ public:
 
     void add(QueueInfo *info);
 
+    void setPriority(QueueInfo *info, int priority);
+
+    //queues a failed title again
+    void retry(QueueInfo *info);
+
+    void setRateLimit(qint64 bytesPerSecond);
+
+    //caps a single title on top of the global limit, zero lifts it
+    void setRateLimit(QueueInfo *info, qint64 bytesPerSecond);
+
+    void setBandwidthProfiles(const QList<BandwidthProfile>& profiles);
+
+    void setMaxConnections(int connections);
+
+    //opens the crash journal and returns the items it still holds
+    QList<DownloadJournal::Entry> restore(const QString& journalPath);
+
+    //drops a journaled item that can no longer be queued
+    void discard(const QString& id);
+
+    int connections() const { return controller.limit(); }
+
     bool exists(QueueInfo *info);
 
-    bool DownloadSingle(QUrl url, QString filepath, QueueInfo *info);
+    //the titles still waiting or downloading, in queue order
+    QList<QueueInfo*> items() const { return queue; }
 
     static bool isHttpRedirect(QNetworkReply *reply);
 
     static DownloadQueue *instance;
 
+    RateLimiter limiter;
+
+    static const int SampleInterval = 2000;
+
+    //a failed content is tried again this often, waiting twice as long
+    //each time, before its title is marked failed
+    static const int MaxRetries = 3;
+    static const int RetryDelay = 2000;
+
 signals:
     void OnEnqueue(QueueInfo *info);
     void OnDequeue(QueueInfo *info);
     void QueueFinished(QList<QueueInfo*> history);
+    //every read, for tools that time the first byte; the window polls
+    //the progress tracker instead
     void DownloadProgress(qint64 received, qint64 total, QTime time);
 
 public slots:
-    void progress(qint64 received, qint64 total);
+    void applyProfiles();
+
+private slots:
+    void progress(qint64 bytes);
+    void transferFinished(DownloadTransfer *transfer);
+    void sample();
 
 private:
+    void insert(QueueInfo *info);
+    QueueInfo *next() const;
+    void preempt();
+    void schedule();
+    void finishActive();
+
     QList<QueueInfo*> history;
     QQueue<QueueInfo*> queue;
     QTime downloadTime;
+    qint64 traceStart = -1;
+    QueueInfo *active = nullptr;
+    bool preempted = false;
+    bool failed = false;
+    int retrying = 0;
+    int run = 0;
+    QHash<QString, int> attempts;
+    qint64 rateLimit = 0;
+    QList<BandwidthProfile> profiles;
+    QTimer profileTimer;
+    QNetworkAccessManager *manager = nullptr;
+    QList<QueueContent> pending;
+    QList<DownloadTransfer*> transfers;
+    ConcurrencyController controller;
+    QTimer sampleTimer;
+    QElapsedTimer sampleClock;
+    DownloadJournal journal;
 };
 
 #endif // NETWORK_H
@@ -0,0 +1,369 @@
+#include <QThread>
+#include "downloadsink.h"
+#include "cemu/verifier.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace
+{
+    Counter *const downloadedBytes = Metrics::counter("download_bytes_total", "Bytes received from the content servers.");
+    Histogram *const writeLatency = Metrics::histogram("download_write_us", "Time to verify and write one download buffer, in microseconds.");
+}
+
+DownloadSink::DownloadSink() = default;
+
+DownloadSink::~DownloadSink()
+{
+    if (opened)
+    {
+        close(false);
+    }
+    for (int i = 0; i < allocated; i++)
+    {
+        qFreeAligned(ring[i].data);
+    }
+}
+
+bool DownloadSink::open(const QString& filepath, qint64 expectedSize, qint64 resumeFrom)
+{
+    if (opened)
+    {
+        close(false);
+    }
+
+    this->filepath = filepath;
+    file.setFileName(partPath(filepath));
+    if (resumeFrom <= 0 || file.size() < resumeFrom)
+    {
+        resumeFrom = 0;
+    }
+
+    auto mode = resumeFrom ? QIODevice::ReadWrite : QIODevice::WriteOnly;
+    if (!file.open(mode))
+    {
+        error = file.errorString();
+        qCritical() << error;
+        return false;
+    }
+
+    //reserve the whole file up front so the filesystem can lay it out
+    //contiguously instead of growing it on every write
+    if (expectedSize > 0 && !file.resize(expectedSize))
+    {
+        qWarning() << "could not preallocate" << file.fileName() << file.errorString();
+    }
+
+    pending.clear();
+    available.clear();
+    for (int i = 0; i < allocated; i++)
+    {
+        ring[i].size = 0;
+        available.enqueue(i);
+    }
+
+    if (resumeFrom && !file.seek(resumeFrom))
+    {
+        resumeFrom = 0;
+        file.seek(0);
+    }
+
+    current = -1;
+    received = resumeFrom;
+    replay = resumeFrom;
+    replaying = resumeFrom > 0 && verifier;
+    durable.store(resumeFrom);
+    stopping = false;
+    rewind = false;
+    waiting = false;
+    stalled = false;
+    failed = false;
+    error.clear();
+    opened = true;
+
+    //the writer lives as long as the file is open, on the shared pool it
+    //would hold a thread for good and starve the loads and saves queued
+    //behind it
+    writerThread = QThread::create([this] { writer(); });
+    writerThread->start();
+    return true;
+}
+
+qint64 DownloadSink::read(QIODevice *device, qint64 maxSize)
+{
+    if (!opened)
+        return 0;
+
+    qint64 total = 0;
+    stalled = false;
+    while (maxSize < 0 || total < maxSize)
+    {
+        if (current < 0)
+        {
+            QMutexLocker locker(&mutex);
+            if (available.isEmpty() && allocated < BufferCount)
+            {
+                //the writer is behind, the ring grows by one buffer
+                ring[allocated].data = static_cast<char*>(qMallocAligned(BufferSize, BufferAlignment));
+                ring[allocated].size = 0;
+                available.enqueue(allocated++);
+            }
+            if (available.isEmpty())
+            {
+                //the rest stays in the device until the writer frees a buffer
+                stalled = true;
+                waiting = true;
+                break;
+            }
+            current = available.dequeue();
+        }
+
+        auto& buffer = ring[current];
+        auto space = BufferSize - buffer.size;
+        if (maxSize >= 0 && maxSize - total < space)
+        {
+            space = maxSize - total;
+        }
+
+        auto len = device->read(buffer.data + buffer.size, space);
+        if (len <= 0)
+            break;
+
+        buffer.size += len;
+        received += len;
+        total += len;
+        downloadedBytes->add(len);
+
+        if (buffer.size == BufferSize)
+        {
+            submit();
+        }
+    }
+    return total;
+}
+
+bool DownloadSink::close(bool completed)
+{
+    if (!opened)
+        return false;
+
+    if (current >= 0)
+    {
+        if (ring[current].size > 0)
+        {
+            submit();
+        }
+        else
+        {
+            QMutexLocker locker(&mutex);
+            available.enqueue(current);
+            current = -1;
+        }
+    }
+
+    mutex.lock();
+    stopping = true;
+    bufferFilled.wakeAll();
+    mutex.unlock();
+    writerThread->wait();
+    delete writerThread;
+    writerThread = nullptr;
+
+    //drop whatever preallocated space was never filled
+    file.resize(received);
+    file.close();
+    opened = false;
+
+    if (failed)
+    {
+        qCritical() << "download write failed:" << file.fileName() << error;
+        return false;
+    }
+
+    if (completed)
+    {
+        QFile::remove(filepath);
+        if (!QFile::rename(file.fileName(), filepath))
+        {
+            error = "could not rename " + file.fileName();
+            qCritical() << error;
+            return false;
+        }
+    }
+    return true;
+}
+
+void DownloadSink::restart()
+{
+    if (!opened)
+        return;
+
+    //the writer rewinds the file before it takes the next buffer, and
+    //gives up on a replay it is still in the middle of
+    QMutexLocker locker(&mutex);
+    if (current >= 0)
+    {
+        ring[current].size = 0;
+    }
+    while (!pending.isEmpty())
+    {
+        auto index = pending.dequeue();
+        ring[index].size = 0;
+        available.enqueue(index);
+    }
+    received = 0;
+    rewind = true;
+    bufferFilled.wakeOne();
+}
+
+bool DownloadSink::idle() const
+{
+    return pending.isEmpty() && available.count() + (current >= 0 ? 1 : 0) == allocated && !rewind && !replaying;
+}
+
+bool DownloadSink::flush()
+{
+    if (!opened)
+        return true;
+
+    if (current >= 0 && ring[current].size > 0)
+    {
+        submit();
+    }
+
+    QMutexLocker locker(&mutex);
+    if (idle())
+        return true;
+
+    waiting = true;
+    return false;
+}
+
+bool DownloadSink::patch(qint64 offset, const QByteArray& data)
+{
+    if (!flush())
+    {
+        error = "writer is still busy";
+        qCritical() << "could not repair" << file.fileName() << error;
+        return false;
+    }
+
+    auto end = file.pos();
+    bool success = file.seek(offset) && file.write(data) == data.size();
+    file.seek(end);
+    if (!success)
+    {
+        error = file.errorString();
+        qCritical() << "could not repair" << file.fileName() << error;
+    }
+    return success;
+}
+
+void DownloadSink::submit()
+{
+    QMutexLocker locker(&mutex);
+    pending.enqueue(current);
+    current = -1;
+    bufferFilled.wakeOne();
+}
+
+void DownloadSink::writer()
+{
+    //a resumed transfer has to run the bytes already on disk through
+    //the verifier before anything new can be checked
+    if (replay > 0 && verifier)
+    {
+        QByteArray chunk(BufferSize, Qt::Uninitialized);
+        file.seek(0);
+        for (qint64 offset = 0; offset < replay && !rewind;)
+        {
+            auto len = file.read(chunk.data(), qMin(static_cast<qint64>(BufferSize), replay - offset));
+            if (len <= 0)
+                break;
+            verifier->update(chunk.constData(), len);
+            offset += len;
+        }
+        file.seek(replay);
+
+        mutex.lock();
+        replaying = false;
+        mutex.unlock();
+        notify();
+    }
+
+    forever
+    {
+        mutex.lock();
+        while (pending.isEmpty() && !stopping && !rewind)
+        {
+            bufferFilled.wait(&mutex);
+        }
+        if (rewind)
+        {
+            rewind = false;
+            mutex.unlock();
+
+            file.seek(0);
+            durable.store(0);
+            if (verifier)
+            {
+                verifier->reset();
+            }
+            notify();
+            continue;
+        }
+        if (pending.isEmpty())
+        {
+            mutex.unlock();
+            break;
+        }
+        int index = pending.dequeue();
+        mutex.unlock();
+
+        auto& buffer = ring[index];
+        TraceSpan span("download", "write");
+        span.setValue(buffer.size);
+        QElapsedTimer timer;
+        timer.start();
+        if (verifier)
+        {
+            verifier->update(buffer.data, buffer.size);
+        }
+
+        qint64 offset = 0;
+        while (!failed && offset < buffer.size)
+        {
+            auto len = file.write(buffer.data + offset, buffer.size - offset);
+            if (len <= 0)
+            {
+                failed = true;
+                error = file.errorString();
+                break;
+            }
+            offset += len;
+        }
+        if (!failed && file.flush())
+        {
+            durable.fetchAndAddOrdered(buffer.size);
+        }
+        writeLatency->record(timer.nsecsElapsed() / 1000);
+
+        mutex.lock();
+        buffer.size = 0;
+        available.enqueue(index);
+        mutex.unlock();
+        notify();
+    }
+}
+
+void DownloadSink::notify()
+{
+    mutex.lock();
+    bool wake = waiting;
+    waiting = false;
+    mutex.unlock();
+
+    if (wake)
+    {
+        emit writable();
+    }
+}
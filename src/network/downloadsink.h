@@ -0,0 +1,118 @@
+#ifndef DOWNLOADSINK_H
+#define DOWNLOADSINK_H
+
+#include "network_global.h"
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include <atomic>
+
+class ContentVerifier;
+class QThread;
+
+//Receives network data straight into a small ring of large aligned
+//buffers and hands every full buffer to a background writer, so the
+//thread that owns the reply never blocks on disk I/O. When every buffer
+//is waiting for the disk the sink stops taking data, which leaves it in
+//the reply and lets TCP slow the server down, and emits writable once
+//the writer caught up. Buffers are only allocated while the writer falls
+//behind, so a slow link never holds more than one or two of them.
+class DownloadSink : public QObject
+{
+    Q_OBJECT
+public:
+    DownloadSink();
+    ~DownloadSink();
+
+    //opens <filepath>.part and preallocates it to expectedSize, keeping
+    //the first resumeFrom bytes of an interrupted transfer
+    bool open(const QString& filepath, qint64 expectedSize, qint64 resumeFrom = 0);
+
+    //drains up to maxSize bytes the device has buffered into the ring,
+    //stopping early while every buffer is waiting for the disk
+    qint64 read(QIODevice *device, qint64 maxSize = -1);
+
+    //true when the last read stopped because the ring was full
+    bool isStalled() const { return stalled; }
+
+    //discards everything received, used when a resume was refused
+    void restart();
+
+    //truncates to the bytes received and renames the .part file to its
+    //final name when the transfer completed, the writer should be idle
+    //so this does not wait on the disk
+    bool close(bool completed);
+
+    //hands the partly filled buffer to the writer and returns true when
+    //everything is on disk, otherwise writable follows once it is
+    bool flush();
+
+    //overwrites a range of the open file, used to repair bad blocks once
+    //the writer is idle
+    bool patch(qint64 offset, const QByteArray& data);
+
+    //hashes data on the writer thread as it is written, not owned
+    void setVerifier(ContentVerifier *verifier) { this->verifier = verifier; }
+
+    ContentVerifier *contentVerifier() const { return verifier; }
+
+    bool isOpen() const { return opened; }
+
+    qint64 bytesWritten() const { return received; }
+
+    //bytes handed to the operating system, safe to resume from after a crash
+    qint64 bytesOnDisk() const { return durable.load(); }
+
+    QString errorString() const { return error; }
+
+    static QString partPath(const QString& filepath) { return filepath + ".part"; }
+
+    static const int BufferCount = 4;
+    static const int BufferSize = 1024 * 1024;
+    static const int BufferAlignment = 4096;
+
+signals:
+    //a buffer was freed or the writer went idle after a read or flush
+    //had to stop, emitted from the writer thread
+    void writable();
+
+private:
+    struct Buffer
+    {
+        char *data = nullptr;
+        qint64 size = 0;
+    };
+
+    void submit();
+    void writer();
+    void notify();
+    bool idle() const;
+
+    QFile file;
+    QString filepath;
+    ContentVerifier *verifier = nullptr;
+
+    //a fixed array, so the writer never sees it move while a buffer is
+    //added
+    Buffer ring[BufferCount];
+    int allocated = 0;
+    QQueue<int> pending;
+    QQueue<int> available;
+    int current = -1;
+    bool opened = false;
+    bool stopping = false;
+    bool replaying = false;
+    std::atomic<bool> rewind { false };
+    bool waiting = false;
+    bool stalled = false;
+    bool failed = false;
+    qint64 received = 0;
+    qint64 replay = 0;
+    QAtomicInteger<qint64> durable;
+    QString error;
+
+    QMutex mutex;
+    QWaitCondition bufferFilled;
+    QThread *writerThread = nullptr;
+};
+
+#endif // DOWNLOADSINK_H
@@ -0,0 +1,364 @@
+#include "downloadtransfer.h"
+#include "cemu/verifier.h"
+#include "trace.h"
+
+DownloadTransfer::DownloadTransfer(const QueueContent& content, QueueInfo *info, QNetworkAccessManager *manager, RateLimiter *limiter, QObject *parent)
+    : QObject(parent), content(content), info(info), manager(manager), limiter(limiter)
+{
+    throttle.setSingleShot(true);
+    connect(&throttle, &QTimer::timeout, this, &DownloadTransfer::readyRead);
+    connect(&sink, &DownloadSink::writable, this, &DownloadTransfer::writable);
+}
+
+DownloadTransfer::~DownloadTransfer()
+{
+    if (reply)
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void DownloadTransfer::start()
+{
+    traceStart = Trace::isEnabled() ? Trace::now() : -1;
+    verify = info->titleKey.size() == 16 && !content.hash.isEmpty();
+    if (verify && content.hashed)
+    {
+        reply = get(QUrl(content.url.toString() + ".h3"));
+        connect(reply, &QNetworkReply::finished, this, &DownloadTransfer::h3Finished);
+        return;
+    }
+    download();
+}
+
+void DownloadTransfer::abort()
+{
+    aborted = true;
+    if (reply)
+    {
+        reply->abort();
+    }
+}
+
+QNetworkReply *DownloadTransfer::get(const QUrl& url, qint64 offset, qint64 length)
+{
+    QNetworkRequest request(url);
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    if (offset > 0 || length > 0)
+    {
+        QString range = QString("bytes=%1-").arg(offset);
+        if (length > 0)
+        {
+            range += QString::number(offset + length - 1);
+        }
+        request.setRawHeader("Range", range.toLatin1());
+    }
+    return manager->get(request);
+}
+
+QNetworkReply *DownloadTransfer::takeReply()
+{
+    auto finished = reply;
+    reply = nullptr;
+    finished->deleteLater();
+    return finished;
+}
+
+void DownloadTransfer::h3Finished()
+{
+    auto h3reply = takeReply();
+    if (aborted)
+    {
+        interrupted = true;
+        finish(false);
+        return;
+    }
+
+    if (h3reply->error() == QNetworkReply::NoError)
+    {
+        h3 = h3reply->readAll();
+    }
+
+    if (ContentVerifier::verifyH3(h3, content.hash))
+    {
+        QFile h3file(content.filepath + ".h3");
+        if (h3file.open(QIODevice::WriteOnly))
+        {
+            h3file.write(h3);
+            h3file.close();
+        }
+    }
+    else
+    {
+        qWarning() << "invalid h3 for" << content.filepath << "verifying blocks without it";
+        h3.clear();
+    }
+    download();
+}
+
+void DownloadTransfer::download()
+{
+    if (verify)
+    {
+        verifier.reset(new ContentVerifier(info->titleKey, content.index, content.hashed, content.hash, h3));
+    }
+    sink.setVerifier(verifier.data());
+
+    if (!sink.open(content.filepath, content.size, info->resume.take(content.filepath)))
+    {
+        finish(false);
+        return;
+    }
+
+    resumeFrom = sink.bytesWritten();
+    if (content.size > 0 && resumeFrom == content.size)
+    {
+        //every byte reached the disk before a crash cut the rename short,
+        //asking for the range after the last one would only get a 416
+        qInfo() << "Already downloaded" << content.filepath;
+        if (verifier)
+        {
+            verifyContent();
+        }
+        else
+        {
+            finish(true);
+        }
+        return;
+    }
+    if (resumeFrom > 0)
+    {
+        qInfo() << "Resuming" << content.filepath << "at" << resumeFrom;
+    }
+
+    reply = get(content.url, resumeFrom);
+    reply->setReadBufferSize(ReadBufferSize);
+    connect(reply, &QNetworkReply::readyRead, this, &DownloadTransfer::readyRead);
+    connect(reply, &QNetworkReply::metaDataChanged, this, &DownloadTransfer::metaDataChanged);
+    connect(reply, &QNetworkReply::finished, this, &DownloadTransfer::downloadFinished);
+}
+
+void DownloadTransfer::readyRead()
+{
+    if (!reply || !sink.isOpen()) return;
+    if (!reply->isReadable()) return;
+
+    auto allowed = qMin(limiter->available(), info->limiter.available());
+    if (allowed > 0)
+    {
+        auto received = sink.read(reply, allowed);
+        limiter->consume(received);
+        info->limiter.consume(received);
+        info->bytesReceived += received;
+        info->progress->setDone(info->bytesReceived);
+        emit progress(received);
+    }
+
+    //a full ring is picked up again by writable, not by polling
+    if (sink.isStalled())
+    {
+        stage = Reading;
+        return;
+    }
+
+    //nothing more arrives while the reply buffer is full, so poll
+    //again once the limiters have refilled
+    if (reply->bytesAvailable() > 0 && !throttle.isActive())
+    {
+        throttle.start(qMax(1, qMax(limiter->delay(), info->limiter.delay())));
+    }
+}
+
+void DownloadTransfer::metaDataChanged()
+{
+    //the server ignored the range, start over from the first byte
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (resumeFrom > 0 && statusCode == 200)
+    {
+        info->bytesReceived -= resumeFrom;
+        info->progress->setDone(info->bytesReceived);
+        resumeFrom = 0;
+        sink.restart();
+    }
+}
+
+void DownloadTransfer::downloadFinished()
+{
+    throttle.stop();
+    stage = Idle;
+
+    //pick up anything still buffered in the reply, the limiters go into
+    //debt for it so the next reads make up for the burst
+    auto received = sink.read(reply);
+    limiter->consume(received);
+    info->limiter.consume(received);
+    info->bytesReceived += received;
+    info->progress->setDone(info->bytesReceived);
+    emit progress(received);
+    if (sink.isStalled())
+    {
+        stage = Draining;
+        return;
+    }
+
+    auto finished = takeReply();
+    if (finished->error() == QNetworkReply::OperationCanceledError)
+    {
+        qInfo() << "download interrupted:" << content.url;
+        interrupted = true;
+        finish(false);
+        return;
+    }
+    if (finished->error() != QNetworkReply::NoError)
+    {
+        qCritical() << "download failed:" << content.url << finished->errorString();
+        interrupted = true;
+        finish(false);
+        return;
+    }
+
+    if (!verifier)
+    {
+        finish(true);
+        return;
+    }
+    verifyContent();
+}
+
+void DownloadTransfer::verifyContent()
+{
+    //the verifier runs on the writer thread, let it catch up first
+    if (!sink.flush())
+    {
+        stage = Verifying;
+        return;
+    }
+
+    if (verifier->finish())
+    {
+        finish(true);
+        return;
+    }
+
+    if (verifier->isHashed())
+    {
+        repairs = verifier->badRanges();
+        verifier->clearBadRanges();
+        repairNext();
+        return;
+    }
+
+    //a plain content can only be checked once complete, so it gets one
+    //more full attempt
+    qCritical() << "content failed verification:" << content.url;
+    if (attempt++ == 0 && !aborted)
+    {
+        qWarning() << "downloading again:" << content.filepath;
+        //the content starts over from the first byte, so what it already
+        //counted towards the title goes back out
+        info->bytesReceived -= sink.bytesWritten();
+        info->progress->setDone(info->bytesReceived);
+        sink.close(false);
+        download();
+        return;
+    }
+    finish(false);
+}
+
+void DownloadTransfer::repairNext()
+{
+    if (repairs.isEmpty())
+    {
+        finish(true);
+        return;
+    }
+    if (aborted)
+    {
+        interrupted = true;
+        finish(false);
+        return;
+    }
+
+    auto range = repairs.first();
+    qWarning() << "block failed verification, downloading again:" << content.url << range.first;
+    reply = get(content.url, range.first, range.second);
+    connect(reply, &QNetworkReply::finished, this, &DownloadTransfer::repairFinished);
+}
+
+void DownloadTransfer::repairFinished()
+{
+    auto finished = takeReply();
+    auto range = repairs.takeFirst();
+
+    QByteArray data;
+    if (finished->error() == QNetworkReply::NoError)
+    {
+        data = finished->readAll();
+        int statusCode = finished->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (statusCode != 206)
+        {
+            //server ignored the range and sent the whole file
+            data = data.mid(static_cast<int>(range.first), static_cast<int>(range.second));
+        }
+    }
+
+    if (!verifier->verifyBlock(range.first, data.constData(), data.size()) || !sink.patch(range.first, data))
+    {
+        qCritical() << "could not repair block:" << content.url << range.first;
+        finish(false);
+        return;
+    }
+    repairNext();
+}
+
+void DownloadTransfer::writable()
+{
+    auto waiting = stage;
+    stage = Idle;
+    switch (waiting)
+    {
+    case Reading:
+        readyRead();
+        break;
+    case Draining:
+        downloadFinished();
+        break;
+    case Verifying:
+        verifyContent();
+        break;
+    case Finishing:
+        finish(completed);
+        break;
+    case Idle:
+        break;
+    }
+}
+
+void DownloadTransfer::finish(bool completed)
+{
+    //closing only truncates and renames once the writer is done
+    if (!sink.flush())
+    {
+        this->completed = completed;
+        stage = Finishing;
+        return;
+    }
+
+    success = sink.close(completed) && completed;
+    if (!success && !interrupted)
+    {
+        //the content will start over from the first byte, so it no longer
+        //counts towards the title
+        info->bytesReceived -= sink.bytesWritten();
+        info->progress->setDone(info->bytesReceived);
+    }
+    Trace::async("download", "content", reinterpret_cast<quintptr>(this), traceStart, sink.bytesWritten());
+    sink.setVerifier(nullptr);
+    if (interrupted && sink.bytesWritten() > 0)
+    {
+        info->resume[content.filepath] = sink.bytesWritten();
+    }
+    emit finished(this);
+}
@@ -0,0 +1,84 @@
+#ifndef DOWNLOADTRANSFER_H
+#define DOWNLOADTRANSFER_H
+
+#include "queueinfo.h"
+#include "ratelimiter.h"
+#include <QNetworkAccessManager>
+
+class ContentVerifier;
+
+//Downloads a single content of a queued title without blocking: fetches
+//the .h3 file, streams the content into a DownloadSink, verifies it and
+//re-fetches any bad blocks before reporting back to the queue
+class DownloadTransfer : public QObject
+{
+    Q_OBJECT
+public:
+    DownloadTransfer(const QueueContent& content, QueueInfo *info, QNetworkAccessManager *manager, RateLimiter *limiter, QObject *parent = nullptr);
+    ~DownloadTransfer();
+
+    void start();
+
+    void abort();
+
+    bool isSuccessful() const { return success; }
+
+    bool wasInterrupted() const { return interrupted; }
+
+    qint64 bytesOnDisk() const { return sink.bytesOnDisk(); }
+
+    const QueueContent content;
+    QueueInfo *info;
+
+    static const int ReadBufferSize = 1024 * 1024;
+
+signals:
+    void progress(qint64 bytes);
+    void finished(DownloadTransfer *transfer);
+
+private slots:
+    void readyRead();
+    void metaDataChanged();
+    void h3Finished();
+    void downloadFinished();
+    void repairFinished();
+    void writable();
+
+private:
+    //what was left waiting for the sink's writer
+    enum Stage
+    {
+        Idle,
+        Reading,
+        Draining,
+        Verifying,
+        Finishing
+    };
+
+    QNetworkReply *get(const QUrl& url, qint64 offset = 0, qint64 length = 0);
+    QNetworkReply *takeReply();
+    void download();
+    void verifyContent();
+    void repairNext();
+    void finish(bool completed);
+
+    QNetworkAccessManager *manager;
+    RateLimiter *limiter;
+    QNetworkReply *reply = nullptr;
+    DownloadSink sink;
+    QScopedPointer<ContentVerifier> verifier;
+    QByteArray h3;
+    QList<QPair<qint64, qint64>> repairs;
+    QTimer throttle;
+    qint64 resumeFrom = 0;
+    qint64 traceStart = -1;
+    int attempt = 0;
+    Stage stage = Idle;
+    bool completed = false;
+    bool verify = false;
+    bool aborted = false;
+    bool interrupted = false;
+    bool success = false;
+};
+
+#endif // DOWNLOADTRANSFER_H
@@ -2,6 +2,19 @@
 #define QUEUEINFO_H
 
 #include "network_global.h"
+#include "ratelimiter.h"
+#include "progress.h"
+
+struct QueueContent
+{
+    QString filepath;
+    QUrl url;
+    qint64 size;
+    quint16 index;
+    bool hashed;
+    QByteArray hash;
+};
+
 class QueueInfo : public QObject
 {
     Q_OBJECT
@@ -14,35 +27,38 @@ public:
     }
     ~QueueInfo()
     {
-        //delete reply;
     }
 
-    QList<QPair<QString, QUrl>> urls;
+    enum Priority { Low = -1, Normal = 0, High = 1 };
+
+    QList<QueueContent> contents;
+    QString id;
+    QString version;
     QString name;
     QString directory;
     qint64 totalSize = 0;
     qint64 bytesReceived = 0;
     QProgressBar pgbar;
     QVariant userData;
-    QNetworkReply *reply;
-    QFile file;
+    QByteArray titleKey;
+    int priority = Normal;
+    //a content ran out of retries, the title waits for retry()
+    bool failed = false;
+    RateLimiter limiter;
+    QMap<QString, qint64> resume;
+    std::shared_ptr<ProgressTracker> progress;
 
 signals:
     void finished();
 
 public slots:
-    void readyRead()
-    {
-        if (!file.isWritable()) return;
-        if (!reply->isReadable()) return;
-        auto qbyteArray = reply->readAll();
-        auto written = file.write(qbyteArray);
-        updateProgress(bytesReceived += written, totalSize);
-    }
-    void updateProgress(qint64 received, qint64 total)
+    //redraws the bar from whichever job currently owns the title
+    void render()
     {
-        float percent = (static_cast<float>(received) / static_cast<float>(total)) * 100;
-        pgbar.setValue(static_cast<int>(percent));
+        if (progress)
+        {
+            pgbar.setValue(progress->percent());
+        }
     }
 };
 
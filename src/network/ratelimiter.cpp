@@ -0,0 +1,85 @@
+#include <limits>
+#include <QRegExp>
+#include "ratelimiter.h"
+
+void RateLimiter::setRate(qint64 bytesPerSecond)
+{
+    if (this->bytesPerSecond == bytesPerSecond)
+        return;
+
+    this->bytesPerSecond = bytesPerSecond;
+    tokens = 0;
+    clock.start();
+}
+
+qint64 RateLimiter::available()
+{
+    if (bytesPerSecond <= 0)
+        return std::numeric_limits<qint64>::max();
+
+    if (!clock.isValid())
+    {
+        clock.start();
+    }
+
+    //refill for the time that passed, allowing at most one second of burst
+    tokens += clock.restart() * bytesPerSecond / 1000.0;
+    if (tokens > bytesPerSecond)
+    {
+        tokens = bytesPerSecond;
+    }
+    return static_cast<qint64>(tokens);
+}
+
+void RateLimiter::consume(qint64 bytes)
+{
+    if (bytesPerSecond > 0)
+    {
+        tokens -= bytes;
+    }
+}
+
+int RateLimiter::delay() const
+{
+    if (bytesPerSecond <= 0)
+        return 0;
+
+    //wait for roughly a tenth of a second worth of data
+    double wanted = bytesPerSecond / 10.0 - tokens;
+    if (wanted <= 0)
+        return 0;
+    return qMax(1, static_cast<int>(wanted * 1000 / bytesPerSecond));
+}
+
+bool BandwidthProfile::contains(const QTime& time) const
+{
+    if (start <= end)
+    {
+        return time >= start && time < end;
+    }
+    return time >= start || time < end;
+}
+
+QList<BandwidthProfile> BandwidthProfile::parse(const QString& profiles)
+{
+    QList<BandwidthProfile> list;
+    for (const auto& entry : profiles.split(';', QString::SkipEmptyParts))
+    {
+        QRegExp regex("\\s*(\\d{1,2}:\\d{2})\\s*-\\s*(\\d{1,2}:\\d{2})\\s*=\\s*(\\d+)\\s*");
+        if (!regex.exactMatch(entry))
+        {
+            qWarning() << "invalid bandwidth profile" << entry;
+            continue;
+        }
+
+        BandwidthProfile profile;
+        profile.start = QTime::fromString(regex.cap(1), "h:mm");
+        profile.end = QTime::fromString(regex.cap(2), "h:mm");
+        profile.rate = regex.cap(3).toLongLong() * 1024;
+        if (profile.start.isValid() && profile.end.isValid())
+        {
+            list.append(profile);
+        }
+    }
+    return list;
+}
@@ -0,0 +1,46 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include "network_global.h"
+#include <QElapsedTimer>
+
+//Token bucket limiting how many bytes may be read per second,
+//a rate of zero means unlimited
+class RateLimiter
+{
+public:
+    RateLimiter() = default;
+
+    void setRate(qint64 bytesPerSecond);
+
+    qint64 rate() const { return bytesPerSecond; }
+
+    //bytes that may be read right now
+    qint64 available();
+
+    void consume(qint64 bytes);
+
+    //milliseconds until a useful amount of bytes is available again
+    int delay() const;
+
+private:
+    qint64 bytesPerSecond = 0;
+    double tokens = 0;
+    QElapsedTimer clock;
+};
+
+//A rate limit that applies between two times of the day, parsed from
+//"hh:mm-hh:mm=KiB/s" entries separated by ';'. A range may wrap past
+//midnight, e.g. "22:00-06:00=0" lifts the limit overnight.
+struct BandwidthProfile
+{
+    QTime start;
+    QTime end;
+    qint64 rate;
+
+    bool contains(const QTime& time) const;
+
+    static QList<BandwidthProfile> parse(const QString& profiles);
+};
+
+#endif // RATELIMITER_H
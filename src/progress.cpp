@@ -0,0 +1,121 @@
+#include <cmath>
+#include "progress.h"
+
+ProgressMonitor *ProgressMonitor::instance;
+
+ProgressTracker::ProgressTracker(const char *category, const QString& label, Unit unit)
+    : category(category), label(label), unit(unit)
+{
+}
+
+int ProgressTracker::percent() const
+{
+    qint64 all = total();
+    if (all <= 0)
+        return 0;
+
+    return static_cast<int>(qBound<qint64>(0, done() * 100 / all, 100));
+}
+
+qint64 ProgressTracker::eta() const
+{
+    qint64 left = total() - done();
+    if (smoothed <= 0 || left < 0)
+        return -1;
+
+    return static_cast<qint64>(left / smoothed + 0.5);
+}
+
+ProgressMonitor::ProgressMonitor(QObject *parent) : QObject(parent)
+{
+    frameTimer.setTimerType(Qt::CoarseTimer);
+    connect(&frameTimer, &QTimer::timeout, this, &ProgressMonitor::tick);
+}
+
+ProgressMonitor *ProgressMonitor::initialize()
+{
+    if (!instance)
+    {
+        instance = new ProgressMonitor;
+    }
+    return instance;
+}
+
+std::shared_ptr<ProgressTracker> ProgressMonitor::track(const char *category, const QString& label, ProgressTracker::Unit unit)
+{
+    auto tracker = std::make_shared<ProgressTracker>(category, label, unit);
+    auto self = instance;
+    if (!self)
+        return tracker;
+
+    QMutexLocker locker(&self->mutex);
+    self->trackers.append(tracker);
+    locker.unlock();
+
+    QMetaObject::invokeMethod(self, [self]
+    {
+        if (!self->frameTimer.isActive())
+        {
+            self->clock.start();
+            self->frameTimer.start(FrameInterval);
+        }
+    }, Qt::QueuedConnection);
+    return tracker;
+}
+
+void ProgressMonitor::tick()
+{
+    double seconds = clock.restart() / 1000.0;
+    double weight = 1.0 - std::exp(-seconds * 1000.0 / SmoothingWindow);
+    bool changed = false;
+    std::shared_ptr<ProgressTracker> latest;
+
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < trackers.count();)
+    {
+        auto tracker = trackers.at(i);
+        qint64 done = tracker->done();
+        bool finished = tracker->isFinished();
+
+        //the first sample only sets the baseline, so resumed bytes do not
+        //count as speed
+        if (tracker->sampled >= 0 && seconds > 0)
+        {
+            double instant = qMax<qint64>(done - tracker->sampled, 0) / seconds;
+            tracker->smoothed += weight * (instant - tracker->smoothed);
+        }
+        changed = changed || done != tracker->sampled || finished;
+        tracker->sampled = done;
+
+        if (finished)
+        {
+            trackers.remove(i);
+            latest = tracker;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (!trackers.isEmpty())
+    {
+        latest = trackers.last();
+    }
+    if (latest && shown != latest)
+    {
+        shown = latest;
+        changed = true;
+    }
+    bool idle = trackers.isEmpty();
+    locker.unlock();
+
+    if (changed)
+    {
+        emit frame();
+    }
+    if (idle)
+    {
+        frameTimer.stop();
+    }
+}
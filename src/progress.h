@@ -0,0 +1,101 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+//Progress of one job, such as a title download or a decrypt. The thread
+//doing the work only stores to atomics, however often it likes, and the
+//window reads them when it next draws.
+class ProgressTracker
+{
+public:
+    enum Unit
+    {
+        Bytes,
+        Files
+    };
+
+    ProgressTracker(const char *category, const QString& label, Unit unit);
+
+    void setTotal(qint64 total) { totalCount.store(total, std::memory_order_relaxed); }
+
+    void setDone(qint64 done) { doneCount.store(done, std::memory_order_relaxed); }
+
+    void add(qint64 n) { doneCount.fetch_add(n, std::memory_order_relaxed); }
+
+    void finish() { finished.store(true, std::memory_order_release); }
+
+    qint64 done() const { return doneCount.load(std::memory_order_relaxed); }
+
+    qint64 total() const { return totalCount.load(std::memory_order_relaxed); }
+
+    bool isFinished() const { return finished.load(std::memory_order_acquire); }
+
+    int percent() const;
+
+    //units per second, smoothed over the last couple of seconds
+    double rate() const { return smoothed; }
+
+    //seconds left at the current rate, negative until there is one
+    qint64 eta() const;
+
+    const char *category;
+    QString label;
+    Unit unit;
+
+private:
+    friend class ProgressMonitor;
+
+    std::atomic<qint64> doneCount { 0 };
+    std::atomic<qint64> totalCount { 0 };
+    std::atomic<bool> finished { false };
+
+    //only touched by the monitor on the gui thread
+    double smoothed = 0;
+    qint64 sampled = -1;
+};
+
+//Samples every running tracker at a fixed frame rate on the gui thread and
+//emits one frame signal when anything moved, so the cost of drawing no
+//longer depends on how often the engines report. The timer stops while no
+//tracker is running.
+class ProgressMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProgressMonitor(QObject *parent = nullptr);
+
+    static ProgressMonitor *initialize();
+
+    static ProgressMonitor *instance;
+
+    //safe from any thread; before the monitor is initialized the tracker
+    //still counts, it is just never drawn
+    static std::shared_ptr<ProgressTracker> track(const char *category, const QString& label, ProgressTracker::Unit unit);
+
+    //the newest running tracker, or the last one to finish
+    std::shared_ptr<ProgressTracker> current() const { return shown; }
+
+    static const int FrameInterval = 33;
+    static const int SmoothingWindow = 2000;
+
+signals:
+    void frame();
+
+private:
+    void tick();
+
+    QTimer frameTimer;
+    QElapsedTimer clock;
+    QMutex mutex;
+    QVector<std::shared_ptr<ProgressTracker>> trackers;
+    std::shared_ptr<ProgressTracker> shown;
+};
+
+#endif // PROGRESS_H
@@ -0,0 +1,129 @@
+#include <QtConcurrent>
+#include "settings.h"
+
+Settings::Settings()
+{
+    QSettings settings(getfilepath(), QSettings::IniFormat);
+    QVariantMap map;
+    for (const auto& key : settings.allKeys())
+    {
+        map.insert(key, settings.value(key));
+    }
+    values = std::make_shared<const QVariantMap>(map);
+
+    flushTimer.setSingleShot(true);
+    connect(&flushTimer, &QTimer::timeout, this, [this]
+    {
+        QtConcurrent::run([this] { flush(); });
+    });
+}
+
+Settings *Settings::instance()
+{
+    //settings are read before anything else exists, during static
+    //initialisation included, so the store is created on first use
+    static Settings *settings = new Settings;
+    return settings;
+}
+
+Settings *Settings::initialize()
+{
+    qInfo() << "initializing settings";
+    QCoreApplication::setOrganizationName("Maple-Tree");
+    QCoreApplication::setOrganizationDomain("mapleseed.pixxy.in");
+    QCoreApplication::setApplicationName("MapleSeed++");
+
+    auto settings = instance();
+    connect(qApp, &QCoreApplication::aboutToQuit, settings, &Settings::sync);
+    return settings;
+}
+
+void Settings::setValue(const QString &key, const QVariant &value)
+{
+    auto settings = instance();
+    {
+        QMutexLocker locker(&settings->writer);
+        auto next = std::make_shared<QVariantMap>(*settings->values);
+        next->insert(key, value);
+        std::atomic_store(&settings->values, std::shared_ptr<const QVariantMap>(next));
+        settings->pending.insert(key, value);
+    }
+    settings->scheduleFlush();
+    emit settings->changed(key, value);
+}
+
+QVariant Settings::value(const QString &key, const QVariant &defaultValue)
+{
+    auto values = std::atomic_load(&instance()->values);
+    auto it = values->constFind(key);
+    return it != values->constEnd() ? it.value() : defaultValue;
+}
+
+void Settings::clear()
+{
+    auto settings = instance();
+    QStringList keys;
+    {
+        QMutexLocker locker(&settings->writer);
+        keys = settings->values->keys();
+        std::atomic_store(&settings->values, std::make_shared<const QVariantMap>());
+        settings->pending.clear();
+        settings->cleared = true;
+    }
+    settings->scheduleFlush();
+
+    //listeners hear every key that went back to its default, with an
+    //invalid value standing in for it
+    for (const auto& key : keys)
+    {
+        emit settings->changed(key, QVariant());
+    }
+}
+
+void Settings::sync()
+{
+    instance()->flush();
+}
+
+void Settings::scheduleFlush()
+{
+    //the timer belongs to the gui thread, writers elsewhere ask it to start
+    QMetaObject::invokeMethod(this, [this]
+    {
+        if (!flushTimer.isActive())
+        {
+            flushTimer.start(FlushDelay);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void Settings::flush()
+{
+    QMutexLocker diskLocker(&disk);
+
+    QVariantMap batch;
+    bool clearFile;
+    {
+        QMutexLocker locker(&writer);
+        batch.swap(pending);
+        clearFile = cleared;
+        cleared = false;
+    }
+    if (batch.isEmpty() && !clearFile)
+        return;
+
+    QSettings settings(getfilepath(), QSettings::IniFormat);
+    if (clearFile)
+    {
+        settings.clear();
+    }
+    for (auto it = batch.constBegin(); it != batch.constEnd(); ++it)
+    {
+        settings.setValue(it.key(), it.value());
+    }
+    settings.sync();
+    if (settings.status() != QSettings::NoError)
+    {
+        qWarning() << "could not write settings" << getfilepath();
+    }
+}
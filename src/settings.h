@@ -3,42 +3,38 @@
 
 #include <QtDebug>
 #include <QCoreApplication>
+#include <QMutex>
+#include <QObject>
 #include <QSettings>
 #include <QDir>
+#include <QTimer>
+#include <QVariantMap>
+#include <memory>
 
-class Settings
+//Process wide copy of MapleSeed.ini. The file is read once and every
+//value() is served from an immutable map that setValue() replaces, so a
+//read never touches the disk or waits on a writer. Writes collect in a
+//pending batch that is flushed to the file in the background a moment
+//later, and once more when the application quits.
+class Settings : public QObject
 {
+    Q_OBJECT
 public:
-    Settings()
-    {
-        qInfo() << "initializing settings";
-        QCoreApplication::setOrganizationName("Maple-Tree");
-        QCoreApplication::setOrganizationDomain("mapleseed.pixxy.in");
-        QCoreApplication::setApplicationName("MapleSeed++");
-    }
-    ~Settings()
-    {
-        QSettings settings(getfilepath(), QSettings::IniFormat);
-        settings.sync();
-    }
+    static Settings *instance();
 
-    static void setValue(const QString &key, const QVariant &value)
-    {
-        QSettings settings(getfilepath(), QSettings::IniFormat);
-        return settings.setValue(key, value);
-    }
+    //names the application and makes sure pending writes reach the disk
+    //on quit, called once the QApplication exists
+    static Settings *initialize();
 
-    static QVariant value(const QString &key)
-    {
-        QSettings settings(getfilepath(), QSettings::IniFormat);
-        return settings.value(key);
-    }
+    static void setValue(const QString &key, const QVariant &value);
 
-    static void clear()
-    {
-        QSettings settings(getfilepath(), QSettings::IniFormat);
-        return settings.clear();
-    }
+    static QVariant value(const QString &key, const QVariant &defaultValue = QVariant());
+
+    //drops every value, emitting changed with an invalid value for each
+    static void clear();
+
+    //writes whatever is pending right away
+    static void sync();
 
     static QString getdirpath()
     {
@@ -50,6 +46,27 @@ public:
     {
         return QDir(getdirpath()).filePath("MapleSeed.ini");
     }
+
+    static const int FlushDelay = 500;
+
+private:
+    Settings();
+
+    void scheduleFlush();
+    void flush();
+
+    std::shared_ptr<const QVariantMap> values;
+
+    QMutex writer;
+    QVariantMap pending;
+    bool cleared = false;
+
+    //held for a whole flush so batches reach the file in order
+    QMutex disk;
+    QTimer flushTimer;
+
+signals:
+    void changed(const QString &key, const QVariant &value);
 };
 
 #endif // MSETTINGS_H
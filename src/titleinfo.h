@@ -4,25 +4,136 @@
 #include <QString>
 #include <QDir>
 #include <QDirIterator>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
 #include "settings.h"
 
 enum TitleType { Game = 0, Demo = 1, Patch = 2, Dlc = 3, None };
 
+//A title from the database with every field parsed once up front, so the
+//accessors used while sorting, filtering and drawing lists are plain member
+//reads. Json fields without a column of their own are kept in extra, or as
+//the json text itself until toMap needs them when read from the snapshot.
 struct TitleInfo
 {
     TitleInfo() {}
-    TitleInfo(QMap<QString, QVariant> qdata) : data(qdata) {}
+    TitleInfo(const QMap<QString, QVariant>& qdata) { assign(qdata); }
+    TitleInfo(const QString& id, const QString& key, const QString& name, const QString& region, const QString& productcode,
+              const QMap<QString, QVariant>& extra = QMap<QString, QVariant>())
+    {
+        assign(id, key, name, region, productcode, extra);
+    }
+    TitleInfo(const QString& id, const QString& key, const QString& name, const QString& region, const QString& productcode,
+              const QString& extraJson)
+    {
+        assign(id, key, name, region, productcode, QMap<QString, QVariant>());
+        this->extraJson = extraJson;
+    }
     TitleInfo& operator=(const QMap<QString, QVariant>& other)
     {
-        data = other;
+        assign(other);
         return *this;
     }
-    QString id() { return data["id"].toString().toUpper(); }
-    QString key() { return data["key"].toString().toUpper(); }
-    QString name() { return data["name"].toString().replace('\n', ' '); }
-    QString region() { return data["region"].toString().toUpper(); }
-    QString productcode() { return data["productcode"].toString(); }
-    QString dir()
+    QString id() const { return idText; }
+    quint64 titleId() const { return number; }
+    QString key() const { return titleKey; }
+    QString name() const { return displayName; }
+    QString region() const { return regions()[regionIndex]; }
+    QString productcode() const { return code; }
+    TitleType titleType() const { return type; }
+    QString formatName() const { return formattedName; }
+
+    //the record as the json object it was read from
+    QMap<QString, QVariant> toMap() const
+    {
+        QMap<QString, QVariant> map(extraJson.isEmpty() ? extra : QJsonDocument::fromJson(extraJson.toUtf8()).object().toVariantMap());
+        map["id"] = idText;
+        map["key"] = titleKey;
+        map["name"] = rawName;
+        map["region"] = region();
+        map["productcode"] = code;
+        return map;
+    }
+
+    //whether two records carry the same fields, compared as they are
+    //stored so json kept as text is never parsed
+    bool sameRecord(const TitleInfo& other) const
+    {
+        if (number != other.number || regionIndex != other.regionIndex || idText != other.idText ||
+            titleKey != other.titleKey || rawName != other.rawName || code != other.code)
+            return false;
+
+        if (extraJson.isEmpty() && other.extraJson.isEmpty())
+            return extra == other.extra;
+        return extraText() == other.extraText();
+    }
+
+    void assign(const QMap<QString, QVariant>& qdata)
+    {
+        QMap<QString, QVariant> rest(qdata);
+        auto id = rest.take("id").toString();
+        auto key = rest.take("key").toString();
+        auto name = rest.take("name").toString();
+        auto region = rest.take("region").toString();
+        auto productcode = rest.take("productcode").toString();
+        assign(id, key, name, region, productcode, rest);
+    }
+
+    void assign(const QString& id, const QString& key, const QString& name, const QString& region, const QString& productcode,
+                const QMap<QString, QVariant>& extra)
+    {
+        idText = id.toUpper();
+        titleKey = key.toUpper();
+        rawName = name;
+        displayName = name.contains('\n') ? QString(name).replace('\n', ' ') : name;
+        code = productcode;
+        regionIndex = internRegion(region.toUpper());
+        this->extra = extra;
+        extraJson.clear();
+
+        bool ok = false;
+        number = idText.size() == 16 ? idText.toULongLong(&ok, 16) : 0;
+        type = ok ? typeOf(number) : TitleType::None;
+
+        switch (type) {
+        case TitleType::Patch:
+            formattedName = QString("[") + this->region() + QString("][Update] ") + displayName;
+            break;
+        case TitleType::Dlc:
+            formattedName = QString("[") + this->region() + QString("][DLC] ") + displayName;
+            break;
+        case TitleType::Demo:
+            formattedName = QString("[") + this->region() + QString("][Demo] ") + displayName;
+            break;
+        case TitleType::Game:
+            formattedName = QString("[") + this->region() + QString("] ") + displayName;
+            break;
+        case TitleType::None:
+            formattedName = QString("[") + this->region() + QString("][Unknown] ") + displayName;
+            break;
+        }
+    }
+
+    //the title type is the low nibble of the upper half of the id
+    static TitleType typeOf(quint64 titleId)
+    {
+        switch ((titleId >> 32) & 0xF) {
+        case 0xE:
+            return TitleType::Patch;
+        case 0xC:
+            return TitleType::Dlc;
+        case 0x2:
+            return TitleType::Demo;
+        case 0x0:
+            return TitleType::Game;
+        }
+        return TitleType::None;
+    }
+
+    QString dir() const
     {
         QDir dir(Settings::value("cemu/library").toString());
 
@@ -57,7 +168,7 @@ struct TitleInfo
         name.remove(QRegExp("[\\/:*?""<>|]"));
         return QDir(dir.filePath(name)).absolutePath();
     }
-    QString coverArt()
+    QString coverArt() const
     {
         QString code(getProductCode());
         QString cover;
@@ -74,61 +185,147 @@ struct TitleInfo
 
         return cover;
     }
-    QString getProductCode()
+    QString getProductCode() const
     {
         if (!productcode().isEmpty()) {
             return productcode().right(4);
         }
         return nullptr;
     }
-    QString formatName() {
-        switch (titleType()) {
+    QString Rpx() const
+    {
+        QString root = QFileInfo(XmlPath).dir().filePath("../code");
+        QDirIterator it(root, QStringList() << "*.rpx", QDir::NoFilter);
+        while (it.hasNext())
+        {
+            return QFileInfo(it.next()).absoluteFilePath();
+        }
+        return nullptr;
+    }
+
+    QString XmlPath;
+
+private:
+    //the extra fields as the compact json the snapshot stores them in
+    QString extraText() const
+    {
+        if (!extraJson.isEmpty() || extra.isEmpty())
+            return extraJson;
+        return QString::fromUtf8(QJsonDocument(QJsonObject::fromVariantMap(extra)).toJson(QJsonDocument::Compact));
+    }
+
+    //regions repeat across thousands of titles, so each distinct one is
+    //stored once and titles keep a small index into the table. Slots are
+    //written once, before the index is handed out, so readers never need
+    //the lock; slot 0 is the empty region.
+    static const int MaxRegions = 256;
+
+    static QString *regions()
+    {
+        static QString table[MaxRegions];
+        return table;
+    }
+
+    static quint8 internRegion(const QString& region)
+    {
+        static QMutex mutex;
+        static std::atomic<int> count { 1 };
+        QMutexLocker locker(&mutex);
+
+        auto table = regions();
+        int used = count.load(std::memory_order_relaxed);
+        for (int i = 0; i < used; i++)
+        {
+            if (table[i] == region)
+                return static_cast<quint8>(i);
+        }
+
+        if (used == MaxRegions)
+        {
+            static bool warned = false;
+            if (!warned)
+            {
+                qWarning() << "more than" << MaxRegions << "regions, further ones are shown without a region, first was" << region;
+                warned = true;
+            }
+            return 0;
+        }
+
+        table[used] = region;
+        count.store(used + 1, std::memory_order_release);
+        return static_cast<quint8>(used);
+    }
+
+    quint64 number = 0;
+    TitleType type = TitleType::None;
+    quint8 regionIndex = 0;
+    QString idText;
+    QString titleKey;
+    QString rawName;
+    QString displayName;
+    QString formattedName;
+    QString code;
+    QMap<QString, QVariant> extra;
+    QString extraJson;
+};
+
+//A game together with the demo, update and DLC that share the low half
+//of its title id
+struct TitleFamily
+{
+    const TitleInfo *game = nullptr;
+    const TitleInfo *demo = nullptr;
+    const TitleInfo *update = nullptr;
+    const TitleInfo *dlc = nullptr;
+
+    void set(const TitleInfo *info)
+    {
+        switch (info->titleType()) {
+        case TitleType::Game:
+            game = info;
+            break;
+        case TitleType::Demo:
+            demo = info;
+            break;
         case TitleType::Patch:
-            return QString("[") + region().toUpper() + QString("][Update] ") + name();
+            update = info;
+            break;
         case TitleType::Dlc:
-            return QString("[") + region().toUpper() + QString("][DLC] ") + name();
-        case TitleType::Demo:
-            return QString("[") + region().toUpper() + QString("][Demo] ") + name();
-        case TitleType::Game:
-            return QString("[") + region().toUpper() + QString("] ") + name();
+            dlc = info;
+            break;
         case TitleType::None:
-            return QString("[") + region().toUpper() + QString("][Unknown] ") + name();
+            break;
         }
-        return nullptr;
     }
-    TitleType titleType()
+
+    void unset(const TitleInfo *info)
     {
-        if (id().size() == 16)
+        for (auto slot : { &game, &demo, &update, &dlc })
         {
-            QChar ch = id().at(7);
-            if (ch == 'e' || ch == 'E') {
-                return TitleType::Patch;
-            }
-            else if (ch == 'c' || ch == 'C') {
-                return TitleType::Dlc;
-            }
-            else if (ch == '2') {
-                return TitleType::Demo;
-            }
-            else if (ch == '0') {
-                return TitleType::Game;
+            if (*slot == info)
+            {
+                *slot = nullptr;
             }
         }
-        return None;
     }
-    QString Rpx()
+
+    bool isEmpty() const { return !game && !demo && !update && !dlc; }
+
+    //game, update and dlc, the titles worth downloading together
+    QList<const TitleInfo*> downloads() const
     {
-        QString root = QFileInfo(XmlPath).dir().filePath("../code");
-        QDirIterator it(root, QStringList() << "*.rpx", QDir::NoFilter);
-        while (it.hasNext())
+        QList<const TitleInfo*> list;
+        for (auto info : { game, update, dlc })
         {
-            return QFileInfo(it.next()).absoluteFilePath();
+            if (info)
+            {
+                list.append(info);
+            }
         }
-        return nullptr;
+        return list;
     }
 
-    QMap<QString, QVariant> data;
-    QString XmlPath;
+    static quint64 key(quint64 titleId) { return titleId & 0xFFFFFFFF; }
 };
 
 #endif // TITLEINFO_H
@@ -0,0 +1,242 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QtDebug>
+#include <memory>
+#include <vector>
+#include "trace.h"
+
+std::atomic<bool> Trace::enabled { false };
+
+namespace
+{
+    //only the owning thread appends, the exporter reads up to count, and
+    //chunks are never freed so a reader can not lose them under its feet.
+    //The owner rewinds count when it sees tracing was switched on again.
+    struct ThreadBuffer
+    {
+        int tid = 0;
+        int session = 0;
+        QString name;
+        std::atomic<Trace::Event*> chunks[Trace::MaxChunks];
+        std::atomic<int> count { 0 };
+
+        ThreadBuffer()
+        {
+            for (auto& chunk : chunks)
+            {
+                chunk.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    QMutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> registry;
+    std::atomic<qint64> since { 0 };
+    std::atomic<int> dropped { 0 };
+    std::atomic<int> session { 0 };
+    thread_local ThreadBuffer *local = nullptr;
+
+    QElapsedTimer& clock()
+    {
+        static QElapsedTimer timer = []
+        {
+            QElapsedTimer timer;
+            timer.start();
+            return timer;
+        }();
+        return timer;
+    }
+
+    ThreadBuffer *threadBuffer()
+    {
+        if (local)
+            return local;
+
+        auto buffer = new ThreadBuffer;
+        auto thread = QThread::currentThread();
+        buffer->name = thread->objectName();
+        if (buffer->name.isEmpty())
+        {
+            bool gui = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread();
+            buffer->name = gui ? QString("GUI") : QString("Worker");
+        }
+
+        buffer->session = session.load(std::memory_order_relaxed);
+
+        QMutexLocker locker(&registryMutex);
+        buffer->tid = static_cast<int>(registry.size()) + 1;
+        registry.emplace_back(buffer);
+        local = buffer;
+        return buffer;
+    }
+
+    void writeEvent(QByteArray& json, const char *phase, const Trace::Event& event, qint64 ts, int tid, qint64 pid)
+    {
+        json += "{\"name\":\"";
+        json += event.name;
+        json += "\",\"cat\":\"";
+        json += event.category;
+        json += "\",\"ph\":\"";
+        json += phase;
+        json += "\",\"ts\":";
+        json += QByteArray::number(ts / 1000.0, 'f', 3);
+        if (*phase == 'X')
+        {
+            json += ",\"dur\":";
+            json += QByteArray::number(event.duration / 1000.0, 'f', 3);
+        }
+        if (event.id)
+        {
+            json += ",\"id\":\"0x";
+            json += QByteArray::number(static_cast<qulonglong>(event.id), 16);
+            json += "\"";
+        }
+        json += ",\"pid\":";
+        json += QByteArray::number(pid);
+        json += ",\"tid\":";
+        json += QByteArray::number(tid);
+        if (event.value >= 0 && *phase != 'e')
+        {
+            json += ",\"args\":{\"value\":";
+            json += QByteArray::number(event.value);
+            json += "}";
+        }
+        json += "},\n";
+    }
+}
+
+void Trace::setEnabled(bool on)
+{
+    if (on && !enabled)
+    {
+        since = now();
+        dropped = 0;
+        session++;
+    }
+    enabled = on;
+    qInfo() << "tracing" << (on ? "enabled" : "disabled");
+}
+
+qint64 Trace::now()
+{
+    return clock().nsecsElapsed();
+}
+
+void Trace::complete(const char *category, const char *name, qint64 start, qint64 value)
+{
+    append({ category, name, start, now() - start, value, 0 });
+}
+
+void Trace::async(const char *category, const char *name, quintptr id, qint64 start, qint64 value)
+{
+    if (!isEnabled() || start < 0)
+        return;
+
+    append({ category, name, start, now() - start, value, id ? id : 1 });
+}
+
+void Trace::append(const Event& event)
+{
+    auto buffer = threadBuffer();
+
+    //spans from an earlier session are never saved again, so their slots
+    //are reused. The lock keeps save from reading a slot being rewritten.
+    int current = session.load(std::memory_order_relaxed);
+    if (buffer->session != current)
+    {
+        QMutexLocker locker(&registryMutex);
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->session = current;
+    }
+
+    int count = buffer->count.load(std::memory_order_relaxed);
+    int index = count / ChunkSize;
+    if (index >= MaxChunks)
+    {
+        dropped++;
+        return;
+    }
+
+    auto chunk = buffer->chunks[index].load(std::memory_order_relaxed);
+    if (!chunk)
+    {
+        chunk = new Event[ChunkSize];
+        buffer->chunks[index].store(chunk, std::memory_order_release);
+    }
+    chunk[count % ChunkSize] = event;
+    buffer->count.store(count + 1, std::memory_order_release);
+}
+
+bool Trace::save(const QString& path)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "could not write trace" << file.errorString();
+        return false;
+    }
+
+    auto pid = QCoreApplication::applicationPid();
+    qint64 from = since;
+    int written = 0;
+
+    QByteArray json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    QMutexLocker locker(&registryMutex);
+    for (const auto& buffer : registry)
+    {
+        QString name(buffer->name);
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + QByteArray::number(pid) +
+                ",\"tid\":" + QByteArray::number(buffer->tid) +
+                ",\"args\":{\"name\":\"" + name.replace('"', '\'').toUtf8() + "\"}},\n";
+
+        int count = buffer->count.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++)
+        {
+            auto chunk = buffer->chunks[i / ChunkSize].load(std::memory_order_acquire);
+            const auto& event = chunk[i % ChunkSize];
+            if (event.start < from)
+                continue;
+
+            if (event.id)
+            {
+                writeEvent(json, "b", event, event.start, buffer->tid, pid);
+                writeEvent(json, "e", event, event.start + event.duration, buffer->tid, pid);
+            }
+            else
+            {
+                writeEvent(json, "X", event, event.start, buffer->tid, pid);
+            }
+            written++;
+
+            if (json.size() > 1024 * 1024)
+            {
+                file.write(json);
+                json.clear();
+            }
+        }
+    }
+    locker.unlock();
+
+    //the last entry can not end in a comma
+    if (json.endsWith(",\n"))
+    {
+        json.chop(2);
+    }
+    else
+    {
+        json += "{}";
+    }
+    json += "\n]}\n";
+    file.write(json);
+
+    if (!file.commit())
+    {
+        qWarning() << "could not write trace" << file.errorString();
+        return false;
+    }
+    qInfo() << "saved" << written << "trace events to" << path << "," << dropped.load() << "dropped";
+    return true;
+}
@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtCore/qglobal.h>
+#include <QString>
+#include <atomic>
+
+//Timing spans for finding out where a download, decrypt or library scan
+//spends its time. Every thread appends to a buffer of its own, so taking
+//a span only locks the first time after tracing is switched on, and while
+//tracing is off a span costs one relaxed load. Switching tracing on again
+//frees the buffers for the new session. The spans can be saved as Chrome trace json, which chrome://tracing
+//and ui.perfetto.dev both open. Names and categories must be literals,
+//only the pointers are kept.
+class Trace
+{
+public:
+    struct Event
+    {
+        const char *category;
+        const char *name;
+        qint64 start;
+        qint64 duration;
+        qint64 value;
+        quintptr id;
+    };
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool on);
+
+    //monotonic nanoseconds since the process started
+    static qint64 now();
+
+    //a span that ended on the calling thread, value is shown in its
+    //arguments unless negative
+    static void complete(const char *category, const char *name, qint64 start, qint64 value = -1);
+
+    //a span that began and ended in different callbacks, the id keeps
+    //overlapping ones apart
+    static void async(const char *category, const char *name, quintptr id, qint64 start, qint64 value = -1);
+
+    //writes every span recorded since tracing was last switched on
+    static bool save(const QString& path);
+
+    static const int ChunkSize = 4096;
+    static const int MaxChunks = 64;
+
+private:
+    static void append(const Event& event);
+
+    static std::atomic<bool> enabled;
+};
+
+//Records the time from its construction to the end of the scope.
+class TraceSpan
+{
+public:
+    TraceSpan(const char *category, const char *name)
+        : category(category), name(name), start(Trace::isEnabled() ? Trace::now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (start >= 0)
+        {
+            Trace::complete(category, name, start, value);
+        }
+    }
+
+    void setValue(qint64 value) { this->value = value; }
+
+private:
+    const char *category;
+    const char *name;
+    qint64 start;
+    qint64 value = -1;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(category, name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, name)
+
+#endif // TRACE_H
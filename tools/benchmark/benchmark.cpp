@@ -0,0 +1,198 @@
+#include <QDir>
+#include <QEventLoop>
+#include <QTextStream>
+#include <algorithm>
+#include "benchmark.h"
+#include "../mockcdn/synthetictitle.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+Benchmark::Benchmark(const BenchmarkOptions& options, QObject *parent) : QObject(parent), options(options)
+{
+    if (!this->options.cdn.endsWith('/'))
+    {
+        this->options.cdn += '/';
+    }
+}
+
+bool Benchmark::start()
+{
+    auto index = get(QUrl(options.cdn).resolved(QUrl("/titles")).toString());
+    auto ids = QString::fromLatin1(index).split('\n', QString::SkipEmptyParts);
+    if (options.titles > 0)
+    {
+        ids = ids.mid(0, options.titles);
+    }
+
+    for (const auto& id : ids)
+    {
+        auto info = queueInfo(id, get(options.cdn + id + "/tmd"));
+        if (info)
+        {
+            infos.append(info);
+            connect(info, &QueueInfo::finished, this, &Benchmark::titleFinished);
+        }
+    }
+
+    if (infos.isEmpty())
+    {
+        qCritical() << "no titles found at" << options.cdn;
+        return false;
+    }
+
+    auto queue = DownloadQueue::initialize();
+    queue->setMaxConnections(options.connections);
+    queue->setRateLimit(options.rateLimit);
+    connect(queue, &DownloadQueue::DownloadProgress, this, &Benchmark::progress);
+    connect(queue, &DownloadQueue::QueueFinished, this, &Benchmark::queueFinished);
+
+    clock.start();
+    cpuStart = cpuTime();
+    waitingFirstByte = true;
+    for (auto info : infos)
+    {
+        totalBytes += info->totalSize;
+        queue->add(info);
+    }
+    return true;
+}
+
+QByteArray Benchmark::get(const QString& url)
+{
+    QNetworkRequest request(url);
+    auto reply = manager.get(request);
+
+    QEventLoop loop;
+    connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    QByteArray data;
+    if (reply->error() == QNetworkReply::NoError)
+    {
+        data = reply->readAll();
+    }
+    else
+    {
+        qWarning() << url << reply->errorString();
+    }
+    reply->deleteLater();
+    return data;
+}
+
+QueueInfo *Benchmark::queueInfo(const QString& id, const QByteArray& tmd)
+{
+    auto entries = SyntheticTitle::parse(tmd);
+    if (entries.isEmpty())
+    {
+        qWarning() << "invalid tmd for" << id;
+        return nullptr;
+    }
+
+    auto info = new QueueInfo(this);
+    info->id = id;
+    info->name = id;
+    info->directory = QDir(output.path()).filePath(id);
+    if (options.verify)
+    {
+        info->titleKey = SyntheticTitle::titleKey(id);
+    }
+    QDir().mkpath(info->directory);
+
+    for (const auto& entry : entries)
+    {
+        QueueContent content;
+        content.filepath = QDir(info->directory).filePath(entry.contentId);
+        content.url = options.cdn + id + "/" + entry.contentId;
+        content.size = entry.size;
+        content.index = entry.index;
+        content.hashed = entry.type & 0x2;
+        content.hash = entry.hash;
+        info->contents.append(content);
+        info->totalSize += entry.size;
+    }
+    return info;
+}
+
+void Benchmark::progress(qint64 received, qint64, QTime)
+{
+    if (waitingFirstByte && received > 0)
+    {
+        firstByte.append(clock.elapsed() - titleStart);
+        waitingFirstByte = false;
+    }
+}
+
+void Benchmark::titleFinished()
+{
+    titleStart = clock.elapsed();
+    waitingFirstByte = true;
+}
+
+void Benchmark::queueFinished()
+{
+    report();
+    emit finished();
+}
+
+void Benchmark::report()
+{
+    auto elapsed = qMax(clock.elapsed(), static_cast<qint64>(1));
+    auto cpu = cpuTime() - cpuStart;
+
+    for (auto info : infos)
+    {
+        for (const auto& content : info->contents)
+        {
+            if (QFileInfo(content.filepath).size() != content.size)
+            {
+                qWarning() << "incomplete" << content.filepath;
+                failures++;
+            }
+        }
+    }
+
+    std::sort(firstByte.begin(), firstByte.end());
+    auto median = firstByte.isEmpty() ? 0 : firstByte.at(firstByte.count() / 2);
+    auto worst = firstByte.isEmpty() ? 0 : firstByte.last();
+    auto gib = static_cast<double>(totalBytes) / (1024.0 * 1024.0 * 1024.0);
+
+    QTextStream out(stdout);
+    out << "titles:        " << infos.count() << endl;
+    out << "bytes:         " << totalBytes << endl;
+    out << "elapsed:       " << elapsed / 1000.0 << " s" << endl;
+    out << "throughput:    " << (totalBytes / (1024.0 * 1024.0)) / (elapsed / 1000.0) << " MiB/s" << endl;
+    out << "ttfb median:   " << median << " ms" << endl;
+    out << "ttfb max:      " << worst << " ms" << endl;
+    out << "cpu:           " << cpu / 1000.0 << " s" << endl;
+    out << "cpu per GiB:   " << (gib > 0 ? cpu / 1000.0 / gib : 0) << " s" << endl;
+    out << "connections:   " << DownloadQueue::instance->connections() << endl;
+    out << "verified:      " << (options.verify ? "yes" : "no") << endl;
+    out << "failures:      " << failures << endl;
+}
+
+qint64 Benchmark::cpuTime()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return static_cast<qint64>((k.QuadPart + u.QuadPart) / 10000);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+#endif
+}
@@ -0,0 +1,63 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QTemporaryDir>
+#include "network/downloadqueue.h"
+
+struct BenchmarkOptions
+{
+    QString cdn = "http://127.0.0.1:8080/ccs/download/";
+    int titles = 0;
+    int connections = 6;
+    qint64 rateLimit = 0;
+    bool verify = true;
+};
+
+//Queues every title the mock server lists into DownloadQueue, waits for
+//the queue to drain and reports throughput, time to first byte of each
+//title and the CPU time spent per GiB received
+class Benchmark : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Benchmark(const BenchmarkOptions& options, QObject *parent = nullptr);
+
+    //queues the titles, false when nothing could be queued
+    bool start();
+
+    //process exit code, non-zero when a content is missing or damaged
+    int result() const { return failures ? 1 : 0; }
+
+    //user plus system time of this process in milliseconds
+    static qint64 cpuTime();
+
+signals:
+    void finished();
+
+private slots:
+    void progress(qint64 received, qint64 total, QTime time);
+    void titleFinished();
+    void queueFinished();
+
+private:
+    QByteArray get(const QString& url);
+    QueueInfo *queueInfo(const QString& id, const QByteArray& tmd);
+    void report();
+
+    BenchmarkOptions options;
+    QNetworkAccessManager manager;
+    QTemporaryDir output;
+    QList<QueueInfo*> infos;
+    QElapsedTimer clock;
+    qint64 cpuStart = 0;
+    qint64 titleStart = 0;
+    bool waitingFirstByte = false;
+    QList<qint64> firstByte;
+    qint64 totalBytes = 0;
+    int failures = 0;
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,58 @@
+#-------------------------------------------------
+#
+# Download throughput benchmark, run against mockcdn
+#
+#-------------------------------------------------
+
+QT += core gui network concurrent widgets
+
+TARGET = benchmark
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ../../src
+
+SOURCES += \
+        main.cpp \
+        benchmark.cpp \
+        ../mockcdn/synthetictitle.cpp \
+        ../../src/cemu/verifier.cpp \
+        ../../src/metrics.cpp \
+        ../../src/network/concurrency.cpp \
+        ../../src/network/downloadjournal.cpp \
+        ../../src/network/downloadqueue.cpp \
+        ../../src/network/downloadsink.cpp \
+        ../../src/network/downloadtransfer.cpp \
+        ../../src/network/queueinfo.cpp \
+        ../../src/network/ratelimiter.cpp \
+        ../../src/progress.cpp \
+        ../../src/trace.cpp
+
+HEADERS += \
+        benchmark.h \
+        ../mockcdn/synthetictitle.h \
+        ../../src/cemu/verifier.h \
+        ../../src/metrics.h \
+        ../../src/network/concurrency.h \
+        ../../src/network/downloadjournal.h \
+        ../../src/network/downloadqueue.h \
+        ../../src/network/downloadsink.h \
+        ../../src/network/downloadtransfer.h \
+        ../../src/network/network_global.h \
+        ../../src/network/queueinfo.h \
+        ../../src/network/ratelimiter.h \
+        ../../src/progress.h \
+        ../../src/trace.h
+
+contains(QT_ARCH, x86_64) {
+unix|win32: LIBS += -LC:/OpenSSL-v111-Win64/lib/ -llibcrypto
+INCLUDEPATH += C:/OpenSSL-v111-Win64/include
+DEPENDPATH += C:/OpenSSL-v111-Win64/include
+} else {
+unix|win32: LIBS += -LC:/OpenSSL-v111-Win32/lib/ -llibcrypto
+INCLUDEPATH += C:/OpenSSL-v111-Win32/include
+DEPENDPATH += C:/OpenSSL-v111-Win32/include
+}
@@ -0,0 +1,37 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include "benchmark.h"
+
+int main(int argc, char *argv[])
+{
+    //queue items own a progress bar, so this needs a widget application;
+    //run with -platform offscreen on machines without a display
+    QApplication a(argc, argv);
+    QCoreApplication::setApplicationName("benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the download queue against a mockcdn server");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"cdn", "Base download url of the server.", "url", "http://127.0.0.1:8080/ccs/download/"},
+        {"titles", "Number of titles to download, 0 for all.", "count", "0"},
+        {"connections", "Maximum concurrent connections.", "count", "6"},
+        {"ratelimit", "Download rate limit in KiB/s, 0 is unlimited.", "kib", "0"},
+        {"no-verify", "Skip content verification."},
+    });
+    parser.process(a);
+
+    BenchmarkOptions options;
+    options.cdn = parser.value("cdn");
+    options.titles = parser.value("titles").toInt();
+    options.connections = parser.value("connections").toInt();
+    options.rateLimit = parser.value("ratelimit").toLongLong() * 1024;
+    options.verify = !parser.isSet("no-verify");
+
+    Benchmark benchmark(options);
+    QObject::connect(&benchmark, &Benchmark::finished, &a, [&] { a.exit(benchmark.result()); });
+    if (!benchmark.start())
+        return 1;
+
+    return a.exec();
+}
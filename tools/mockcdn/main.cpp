@@ -0,0 +1,42 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "mockserver.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("mockcdn");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Local content server with synthetic titles for download benchmarks");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"port", "Port to listen on.", "port", "8080"},
+        {"titles", "Number of synthetic titles.", "count", "2"},
+        {"contents", "Contents per title.", "count", "4"},
+        {"size", "Size of every content in MiB.", "mib", "16"},
+        {"latency", "Delay before each response in milliseconds.", "ms", "0"},
+        {"rate", "Bandwidth per connection in KiB/s, 0 is unlimited.", "kib", "0"},
+        {"no-range", "Ignore Range headers and always send whole files."},
+        {"error-rate", "Percentage of content requests answered with 503.", "percent", "0"},
+        {"reset-rate", "Percentage of content responses dropped halfway.", "percent", "0"},
+    });
+    parser.process(a);
+
+    MockOptions options;
+    options.port = static_cast<quint16>(parser.value("port").toUInt());
+    options.titles = parser.value("titles").toInt();
+    options.contents = parser.value("contents").toInt();
+    options.contentSize = parser.value("size").toLongLong() * 1024 * 1024;
+    options.latency = parser.value("latency").toInt();
+    options.rate = parser.value("rate").toLongLong() * 1024;
+    options.ranges = !parser.isSet("no-range");
+    options.errorRate = parser.value("error-rate").toInt();
+    options.resetRate = parser.value("reset-rate").toInt();
+
+    MockServer server(options);
+    if (!server.listen())
+        return 1;
+
+    return a.exec();
+}
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Local content server used to benchmark downloads
+#
+#-------------------------------------------------
+
+QT += core network
+QT -= gui
+
+TARGET = mockcdn
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        main.cpp \
+        mockserver.cpp \
+        synthetictitle.cpp
+
+HEADERS += \
+        mockserver.h \
+        synthetictitle.h
+
+contains(QT_ARCH, x86_64) {
+unix|win32: LIBS += -LC:/OpenSSL-v111-Win64/lib/ -llibcrypto
+INCLUDEPATH += C:/OpenSSL-v111-Win64/include
+DEPENDPATH += C:/OpenSSL-v111-Win64/include
+} else {
+unix|win32: LIBS += -LC:/OpenSSL-v111-Win32/lib/ -llibcrypto
+INCLUDEPATH += C:/OpenSSL-v111-Win32/include
+DEPENDPATH += C:/OpenSSL-v111-Win32/include
+}
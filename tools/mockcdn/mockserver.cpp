@@ -0,0 +1,240 @@
+#include <QRandomGenerator>
+#include <QRegExp>
+#include <QUrl>
+#include "mockserver.h"
+
+MockServer::MockServer(const MockOptions& options, QObject *parent) : QObject(parent), options(options)
+{
+    for (int i = 0; i < options.titles; i++)
+    {
+        auto id = SyntheticTitle::titleId(i);
+        titles[id] = SyntheticTitle(id, options.contents, options.contentSize);
+        index += id.toLatin1() + "\n";
+    }
+
+    connect(&server, &QTcpServer::newConnection, this, [this]
+    {
+        while (server.hasPendingConnections())
+        {
+            new MockConnection(server.nextPendingConnection(), this);
+        }
+    });
+}
+
+bool MockServer::listen()
+{
+    if (!server.listen(QHostAddress::Any, options.port))
+    {
+        qCritical() << "could not listen on port" << options.port << server.errorString();
+        return false;
+    }
+
+    qInfo() << "serving" << titles.count() << "titles on" << QString("http://127.0.0.1:%1/ccs/download/").arg(server.serverPort());
+    return true;
+}
+
+const QByteArray *MockServer::find(const QString& path, bool *content) const
+{
+    *content = false;
+    if (path == "/titles")
+        return &index;
+
+    auto parts = path.split('/', QString::SkipEmptyParts);
+    if (parts.count() != 4 || parts[0] != "ccs" || parts[1] != "download")
+        return nullptr;
+
+    auto title = titles.find(parts[2].toUpper());
+    if (title == titles.end())
+        return nullptr;
+
+    auto name = parts[3].toLower();
+    if (name == "tmd" || name.startsWith("tmd."))
+        return &title->tmd;
+    if (name == "cetk")
+        return &title->cetk;
+
+    auto file = title->contents.find(name);
+    if (file == title->contents.end())
+        return nullptr;
+
+    *content = true;
+    return &file.value();
+}
+
+MockConnection::MockConnection(QTcpSocket *socket, MockServer *server) : QObject(server), socket(socket), server(server)
+{
+    socket->setParent(this);
+    throttle.setSingleShot(true);
+
+    connect(socket, &QTcpSocket::readyRead, this, &MockConnection::readyRead);
+    connect(socket, &QTcpSocket::disconnected, this, &MockConnection::deleteLater);
+    connect(&throttle, &QTimer::timeout, this, &MockConnection::pump);
+    connect(socket, &QTcpSocket::bytesWritten, this, [this]
+    {
+        //a throttled connection is paced by its timer instead
+        if (!this->server->options.rate)
+        {
+            pump();
+        }
+    });
+}
+
+void MockConnection::readyRead()
+{
+    request += socket->readAll();
+    if (busy)
+        return;
+
+    auto length = request.indexOf("\r\n\r\n");
+    if (length < 0)
+        return;
+
+    head = request.left(length);
+    request.remove(0, length + 4);
+    busy = true;
+
+    if (server->options.latency > 0)
+    {
+        QTimer::singleShot(server->options.latency, this, &MockConnection::respond);
+    }
+    else
+    {
+        respond();
+    }
+}
+
+void MockConnection::respond()
+{
+    auto lines = head.split('\n');
+    auto requestLine = QString::fromLatin1(lines.takeFirst()).trimmed().split(' ');
+    if (requestLine.count() < 2 || (requestLine[0] != "GET" && requestLine[0] != "HEAD"))
+    {
+        reply(405, "Method Not Allowed");
+        return;
+    }
+
+    QString range;
+    for (const auto& line : lines)
+    {
+        auto header = QString::fromLatin1(line).trimmed();
+        if (header.startsWith("range:", Qt::CaseInsensitive))
+        {
+            range = header.mid(6).trimmed();
+        }
+    }
+
+    bool content = false;
+    auto file = server->find(QUrl(requestLine[1]).path(), &content);
+    if (!file)
+    {
+        reply(404, "Not Found");
+        return;
+    }
+
+    if (content && QRandomGenerator::global()->bounded(100) < server->options.errorRate)
+    {
+        reply(503, "Service Unavailable");
+        return;
+    }
+
+    if (requestLine[0] == "HEAD")
+    {
+        reply(200, "OK", file, 0, 0);
+        return;
+    }
+
+    QRegExp bytes("bytes=(\\d+)-(\\d*)");
+    if (server->options.ranges && bytes.exactMatch(range))
+    {
+        auto first = bytes.cap(1).toLongLong();
+        auto last = bytes.cap(2).isEmpty() ? file->size() - 1 : qMin(bytes.cap(2).toLongLong(), static_cast<qint64>(file->size() - 1));
+        if (first >= file->size() || last < first)
+        {
+            reply(416, "Range Not Satisfiable");
+            return;
+        }
+        reply(206, "Partial Content", file, first, last - first + 1);
+        return;
+    }
+
+    reply(200, "OK", file, 0, file->size());
+}
+
+void MockConnection::reply(int status, const QByteArray& reason, const QByteArray *body, qint64 offset, qint64 length)
+{
+    QByteArray response("HTTP/1.1 " + QByteArray::number(status) + " " + reason + "\r\n");
+    response += "Content-Type: application/octet-stream\r\n";
+    response += "Content-Length: " + QByteArray::number(body && length ? length : (body ? body->size() : 0)) + "\r\n";
+    response += server->options.ranges ? "Accept-Ranges: bytes\r\n" : "Accept-Ranges: none\r\n";
+    if (status == 206)
+    {
+        response += "Content-Range: bytes " + QByteArray::number(offset) + "-" + QByteArray::number(offset + length - 1) +
+                "/" + QByteArray::number(body->size()) + "\r\n";
+    }
+    response += "Connection: keep-alive\r\n\r\n";
+    socket->write(response);
+
+    this->body = length > 0 ? body : nullptr;
+    position = offset;
+    end = offset + length;
+    cutoff = -1;
+    if (this->body && QRandomGenerator::global()->bounded(100) < server->options.resetRate)
+    {
+        cutoff = offset + length / 2;
+    }
+    pump();
+}
+
+void MockConnection::pump()
+{
+    if (!body)
+    {
+        done();
+        return;
+    }
+
+    qint64 budget = server->options.rate ? server->options.rate * Tick / 1000 : Backlog - socket->bytesToWrite();
+    if (cutoff >= 0)
+    {
+        budget = qMin(budget, cutoff - position);
+    }
+    budget = qMin(budget, end - position);
+
+    if (budget > 0)
+    {
+        socket->write(body->constData() + position, budget);
+        position += budget;
+    }
+
+    if (position == cutoff)
+    {
+        //simulate a dropped connection in the middle of a transfer
+        body = nullptr;
+        socket->abort();
+        return;
+    }
+
+    if (position == end)
+    {
+        body = nullptr;
+        done();
+        return;
+    }
+
+    if (server->options.rate)
+    {
+        throttle.start(Tick);
+    }
+}
+
+void MockConnection::done()
+{
+    if (!busy)
+        return;
+
+    busy = false;
+    if (!request.isEmpty())
+    {
+        QTimer::singleShot(0, this, &MockConnection::readyRead);
+    }
+}
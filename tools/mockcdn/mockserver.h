@@ -0,0 +1,87 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtDebug>
+#include "synthetictitle.h"
+
+struct MockOptions
+{
+    quint16 port = 8080;
+    int titles = 2;
+    int contents = 4;
+    qint64 contentSize = 16 * 1024 * 1024;
+
+    //delay before every response is started
+    int latency = 0;
+
+    //bytes per second for each connection, 0 is unlimited
+    qint64 rate = 0;
+
+    //honour Range requests, otherwise always answer 200 with everything
+    bool ranges = true;
+
+    //percentage of content requests answered with 503
+    int errorRate = 0;
+
+    //percentage of content responses cut off halfway through the body
+    int resetRate = 0;
+};
+
+//Serves synthetic titles over plain HTTP/1.1 under the same paths as
+//the CDN, /ccs/download/<title id>/{tmd,cetk,<content id>}, so the
+//application can be pointed at it through the download/cdn setting
+class MockServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MockServer(const MockOptions& options, QObject *parent = nullptr);
+
+    bool listen();
+
+    //looks up the file behind a request path, null when there is none
+    const QByteArray *find(const QString& path, bool *content) const;
+
+    const MockOptions options;
+
+private:
+    QTcpServer server;
+    QMap<QString, SyntheticTitle> titles;
+    QByteArray index;
+};
+
+class MockConnection : public QObject
+{
+    Q_OBJECT
+public:
+    MockConnection(QTcpSocket *socket, MockServer *server);
+
+private slots:
+    void readyRead();
+    void respond();
+    void pump();
+
+private:
+    void reply(int status, const QByteArray& reason, const QByteArray *body = nullptr, qint64 offset = 0, qint64 length = 0);
+    void done();
+
+    QTcpSocket *socket;
+    MockServer *server;
+    QByteArray request;
+    QByteArray head;
+    bool busy = false;
+
+    const QByteArray *body = nullptr;
+    qint64 position = 0;
+    qint64 end = 0;
+    qint64 cutoff = -1;
+    QTimer throttle;
+
+    static const int Tick = 10;
+    static const int Backlog = 256 * 1024;
+};
+
+#endif // MOCKSERVER_H
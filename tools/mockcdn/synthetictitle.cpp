@@ -0,0 +1,88 @@
+#include <cstring>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <openssl/aes.h>
+#include "synthetictitle.h"
+
+SyntheticTitle::SyntheticTitle(const QString& id, int contentCount, qint64 contentSize) : id(id)
+{
+    //contents are encrypted whole, so keep them a multiple of the cipher block
+    contentSize = qMax(static_cast<qint64>(AES_BLOCK_SIZE), contentSize & ~static_cast<qint64>(AES_BLOCK_SIZE - 1));
+
+    auto key = titleKey(id);
+    AES_KEY aes;
+    AES_set_encrypt_key(reinterpret_cast<const quint8*>(key.constData()), 128, &aes);
+
+    tmd.fill(0, ContentsOffset + contentCount * ContentEntrySize);
+    auto header = reinterpret_cast<uchar*>(tmd.data());
+    qToBigEndian<quint32>(0x00010004, header);
+    header[0x180] = 1;
+    qToBigEndian<quint64>(id.toULongLong(nullptr, 16), header + 0x18C);
+    qToBigEndian<quint16>(static_cast<quint16>(contentCount), header + 0x1DE);
+
+    QRandomGenerator random(static_cast<quint32>(qHash(id)));
+    for (int i = 0; i < contentCount; i++)
+    {
+        QByteArray plain(static_cast<int>(contentSize), Qt::Uninitialized);
+        random.fillRange(reinterpret_cast<quint32*>(plain.data()), plain.size() / 4);
+
+        quint8 iv[AES_BLOCK_SIZE] = {};
+        iv[0] = static_cast<quint8>(i >> 8);
+        iv[1] = static_cast<quint8>(i);
+
+        QByteArray encrypted(plain.size(), Qt::Uninitialized);
+        AES_cbc_encrypt(reinterpret_cast<const quint8*>(plain.constData()), reinterpret_cast<quint8*>(encrypted.data()),
+                        static_cast<size_t>(plain.size()), &aes, iv, AES_ENCRYPT);
+
+        auto entry = header + ContentsOffset + i * ContentEntrySize;
+        qToBigEndian<quint32>(static_cast<quint32>(i), entry);
+        qToBigEndian<quint16>(static_cast<quint16>(i), entry + 4);
+        qToBigEndian<quint16>(0x2001, entry + 6);
+        qToBigEndian<quint64>(static_cast<quint64>(contentSize), entry + 8);
+        auto hash = QCryptographicHash::hash(plain, QCryptographicHash::Sha1);
+        memcpy(entry + 16, hash.constData(), static_cast<size_t>(hash.size()));
+
+        contents[QString().sprintf("%08x", i)] = encrypted;
+    }
+
+    //the real ticket carries the key encrypted with the common key, the
+    //synthetic one only needs the layout
+    cetk.fill(0, TicketSize);
+    auto ticket = reinterpret_cast<uchar*>(cetk.data());
+    qToBigEndian<quint32>(0x00010004, ticket);
+    memcpy(ticket + 0x1BF, key.constData(), static_cast<size_t>(key.size()));
+    qToBigEndian<quint64>(id.toULongLong(nullptr, 16), ticket + 0x1DC);
+}
+
+QString SyntheticTitle::titleId(int index)
+{
+    return QString("0005000010%1").arg(0x100000 + index * 0x100, 6, 16, QChar('0')).toUpper();
+}
+
+QByteArray SyntheticTitle::titleKey(const QString& id)
+{
+    return QCryptographicHash::hash(id.toUpper().toLatin1(), QCryptographicHash::Sha1).left(AES_BLOCK_SIZE);
+}
+
+QList<SyntheticTitle::Entry> SyntheticTitle::parse(const QByteArray& tmd)
+{
+    QList<Entry> entries;
+    if (tmd.size() < ContentsOffset)
+        return entries;
+
+    auto header = reinterpret_cast<const uchar*>(tmd.constData());
+    int count = qFromBigEndian<quint16>(header + 0x1DE);
+    for (int i = 0; i < count && ContentsOffset + (i + 1) * ContentEntrySize <= tmd.size(); i++)
+    {
+        auto data = header + ContentsOffset + i * ContentEntrySize;
+        Entry entry;
+        entry.contentId = QString().sprintf("%08x", qFromBigEndian<quint32>(data));
+        entry.index = qFromBigEndian<quint16>(data + 4);
+        entry.type = qFromBigEndian<quint16>(data + 6);
+        entry.size = static_cast<qint64>(qFromBigEndian<quint64>(data + 8));
+        entry.hash = QByteArray(reinterpret_cast<const char*>(data + 16), 20);
+        entries.append(entry);
+    }
+    return entries;
+}
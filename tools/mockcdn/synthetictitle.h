@@ -0,0 +1,50 @@
+#ifndef SYNTHETICTITLE_H
+#define SYNTHETICTITLE_H
+
+#include <QtCore/qglobal.h>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+
+//A generated title laid out exactly like one on the real CDN: a TMD in
+//the format CemuCrypto::TitleMetaData reads, a ticket and AES-CBC
+//encrypted contents whose decrypted SHA1 matches the TMD, so the whole
+//download and verification path runs against it unchanged
+class SyntheticTitle
+{
+public:
+    SyntheticTitle() = default;
+    SyntheticTitle(const QString& id, int contentCount, qint64 contentSize);
+
+    QString id;
+    QByteArray tmd;
+    QByteArray cetk;
+
+    //encrypted contents keyed by their 8 digit content id
+    QMap<QString, QByteArray> contents;
+
+    //id of the nth synthetic title
+    static QString titleId(int index);
+
+    //decrypted title key, derived from the id so the benchmark can
+    //verify contents without a common key
+    static QByteArray titleKey(const QString& id);
+
+    //(content id, size, sha1) for every content listed in a tmd
+    struct Entry
+    {
+        QString contentId;
+        quint16 index;
+        quint16 type;
+        qint64 size;
+        QByteArray hash;
+    };
+    static QList<Entry> parse(const QByteArray& tmd);
+
+    static const int ContentsOffset = 0xB04;
+    static const int ContentEntrySize = 0x30;
+    static const int TicketSize = 0x350;
+};
+
+#endif // SYNTHETICTITLE_H